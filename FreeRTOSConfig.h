@@ -53,10 +53,11 @@
 #define configMINIMAL_STACK_SIZE	( ( unsigned short ) 128 )
 #define configTOTAL_HEAP_SIZE		( ( size_t ) ( 17 * 1024 ) )
 #define configMAX_TASK_NAME_LEN		( 16 )
-#define configUSE_TRACE_FACILITY	0
+#define configUSE_TRACE_FACILITY	configGENERATE_RUN_TIME_STATS	/* vTaskGetInfo, see cpu_load_task */
 #define configUSE_16_BIT_TICKS		0
 #define configIDLE_SHOULD_YIELD		1
 #define configUSE_MUTEXES			1
+#define configCHECK_FOR_STACK_OVERFLOW	2	/* vApplicationStackOverflowHook in main.c */
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 		0
@@ -72,6 +73,24 @@ to exclude the API function. */
 #define INCLUDE_vTaskSuspend			1
 #define INCLUDE_vTaskDelayUntil			1
 #define INCLUDE_vTaskDelay				1
+#define INCLUDE_xTaskGetCurrentTaskHandle	1
+#define INCLUDE_xTaskGetIdleTaskHandle	configGENERATE_RUN_TIME_STATS
+
+/* Run time stats, counted in CPU cycles by the DWT cycle counter, for
+measurement builds only (-DconfigGENERATE_RUN_TIME_STATS=1): they add the
+stats hooks to every context switch and cpu_load_task to the firmware. The
+32 bit counter wraps every minute at 72MHz, so only compare counters over
+shorter windows (see cpu_load_task in main.c). */
+#ifndef configGENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS	0
+#endif
+#if configGENERATE_RUN_TIME_STATS
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+/* Runs the counter main() zeroed, without zeroing it again */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	do { SCS_DEMCR |= SCS_DEMCR_TRCENA; DWT_CTRL |= DWT_CTRL_CYCCNTENA; } while ( 0 )
+#define portGET_RUN_TIME_COUNTER_VALUE()		dwt_read_cycle_counter()
+#endif
 
 /* This is the raw value as per the Cortex-M3 NVIC.  Values can be 255
 (lowest) to 0 (1?) (highest). */
@@ -0,0 +1,240 @@
+/* Analog axes
+ * ADC1 in scan mode, started by TIM3 TRGO, with DMA1 channel 1 in circular
+ * mode storing the scans in the two halves of scan_buffer: one is
+ * decimated while DMA fills the other.
+ *
+ * GPIO
+ * ----
+ * PA0..PA7	ADC channels 0..7
+ * PB0, PB1	ADC channels 8, 9
+ */
+#include <stdint.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "adcscan.h"
+#include "usbhid.h"
+
+/*
+ * The DMA interrupt publishes reports, so its priority must be below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY
+ */
+#define ADCSCAN_IRQ_PRIORITY	(configMAX_SYSCALL_INTERRUPT_PRIORITY + 1)
+
+static uint8_t channels[] = { ADCSCAN_CHANNELS };
+
+_Static_assert(sizeof(channels) == ADCSCAN_CHANNEL_COUNT, "ADCSCAN_CHANNELS needs one channel per axis");
+
+/* The sum of ADCSCAN_OVERSAMPLE samples, scaled down to ADCSCAN_BITS and rounded */
+#define ADCSCAN_DECIMATE_SHIFT	(ADCSCAN_OVERSAMPLE_SHIFT - ADCSCAN_OVERSAMPLE_SHIFT / 2)
+#define ADCSCAN_DECIMATE_ROUND	((1 << ADCSCAN_DECIMATE_SHIFT) >> 1)
+
+static volatile uint16_t scan_buffer[2][ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT];
+static struct Joystick_ *joystick;
+static struct adcscan_stats stats;
+static struct axisfilter filters[JOYSTICK_AXIS_COUNT];
+
+void
+adcscan_process(struct Joystick_ *js, const uint16_t block[ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT], BaseType_t *higherPriorityTaskWoken) {
+	uint32_t sum[ADCSCAN_CHANNEL_COUNT];
+	int16_t values[JOYSTICK_AXIS_COUNT];
+	uint8_t axis, scan;
+
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+		sum[axis] = block[0][axis];
+	for ( scan = 1; scan < ADCSCAN_OVERSAMPLE; scan++ )
+		for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+			sum[axis] += block[scan][axis];
+
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ ) {
+		values[axis] = (int16_t)((sum[axis] + ADCSCAN_DECIMATE_ROUND) >> ADCSCAN_DECIMATE_SHIFT);
+		values[axis] = axisfilter_apply(&filters[axis], values[axis]);
+	}
+
+	Joystick_setAxesFromISR(js, values, higherPriorityTaskWoken);	/* one report per block */
+}
+
+/*
+ * Half or whole buffer full: the block DMA has just finished is stable
+ * until DMA wraps around to it again
+ */
+void
+dma1_channel1_isr(void) {
+	BaseType_t woken = pdFALSE;
+	bool half = dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_HTIF);
+	bool full = dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_TCIF);
+	uint32_t start = dwt_read_cycle_counter();
+
+	dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_HTIF | DMA_TCIF);
+
+	if ( half && full ) {		/* Too late, DMA is already overwriting one of them */
+		stats.overruns += 2;
+	} else if ( half || full ) {
+		adcscan_process(joystick, (const uint16_t (*)[ADCSCAN_CHANNEL_COUNT])scan_buffer[full], &woken);
+		++stats.updates;
+		stats.cycles_last = dwt_read_cycle_counter() - start;
+		if ( stats.cycles_last > stats.cycles_max )
+			stats.cycles_max = stats.cycles_last;
+	}
+	portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * Change the filter of one axis, from a task. Its deadband stays.
+ */
+void
+adcscan_set_filter(uint8_t axis, uint8_t medianTaps, uint16_t alpha) {
+	if ( axis >= JOYSTICK_AXIS_COUNT )
+		return;
+
+	taskENTER_CRITICAL();		/* masks the DMA interrupt */
+	axisfilter_set_filter(&filters[axis], medianTaps, alpha);
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * Change the deadzone and hysteresis of one axis, from a task
+ */
+void
+adcscan_set_deadband(uint8_t axis, uint16_t hysteresis, int16_t center, uint16_t deadzone) {
+	if ( axis >= JOYSTICK_AXIS_COUNT )
+		return;
+
+	taskENTER_CRITICAL();
+	axisfilter_set_deadband(&filters[axis], hysteresis, center, deadzone);
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * Copy the counters
+ */
+void
+adcscan_get_stats(struct adcscan_stats *s) {
+	uint8_t axis;
+
+	taskENTER_CRITICAL();
+	*s = stats;
+	s->held = 0;
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+		s->held += filters[axis]._held;
+	taskEXIT_CRITICAL();
+}
+
+static void
+adcscan_gpio_setup(void) {
+	uint16_t pa = 0, pb = 0;
+	uint8_t i;
+
+	for ( i = 0; i < ADCSCAN_CHANNEL_COUNT; i++ ) {
+		if ( channels[i] < 8 )
+			pa |= 1 << channels[i];
+		else if ( channels[i] < 10 )
+			pb |= 1 << (channels[i] - 8);
+	}
+	if ( pa ) {
+		rcc_periph_clock_enable(RCC_GPIOA);
+		gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG, pa);
+	}
+	if ( pb ) {
+		rcc_periph_clock_enable(RCC_GPIOB);
+		gpio_set_mode(GPIOB, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG, pb);
+	}
+}
+
+static void
+adcscan_dma_setup(void) {
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	dma_channel_reset(DMA1, DMA_CHANNEL1);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL1, (uint32_t)&ADC_DR(ADC1));
+	dma_set_memory_address(DMA1, DMA_CHANNEL1, (uint32_t)scan_buffer);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL1, sizeof(scan_buffer) / sizeof(scan_buffer[0][0][0]));
+	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL1);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL1);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL1, DMA_CCR_PSIZE_16BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL1, DMA_CCR_MSIZE_16BIT);
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL1);
+	dma_set_priority(DMA1, DMA_CHANNEL1, DMA_CCR_PL_HIGH);
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL1);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL1);
+
+	nvic_set_priority(NVIC_DMA1_CHANNEL1_IRQ, ADCSCAN_IRQ_PRIORITY);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL1_IRQ);
+
+	dma_enable_channel(DMA1, DMA_CHANNEL1);
+}
+
+static void
+adcscan_adc_setup(void) {
+	uint32_t start;
+
+	rcc_periph_clock_enable(RCC_ADC1);
+	rcc_set_adcpre(RCC_CFGR_ADCPRE_PCLK2_DIV6);	/* 12MHz, 14MHz max */
+
+	adc_power_off(ADC1);
+	adc_set_dual_mode(ADC_CR1_DUALMOD_IND);
+	adc_enable_scan_mode(ADC1);
+	adc_set_single_conversion_mode(ADC1);		/* one scan per trigger */
+	adc_set_right_aligned(ADC1);
+	adc_set_sample_time_on_all_channels(ADC1, ADC_SMPR_SMP_55DOT5CYC);
+	adc_set_regular_sequence(ADC1, ADCSCAN_CHANNEL_COUNT, channels);
+	adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM3_TRGO);
+	adc_enable_dma(ADC1);
+
+	adc_power_on(ADC1);
+	start = dwt_read_cycle_counter();		/* tSTAB, 1us */
+	while ( dwt_read_cycle_counter() - start < rcc_ahb_frequency / 1000000 )
+		;
+	adc_reset_calibration(ADC1);
+	adc_calibrate(ADC1);
+}
+
+/*
+ * TIM3 update event for every scan, ADCSCAN_RATE_HZ * ADCSCAN_OVERSAMPLE
+ * times a second, routed to TRGO
+ */
+static void
+adcscan_timer_setup(void) {
+	rcc_periph_clock_enable(RCC_TIM3);
+	rcc_periph_reset_pulse(RST_TIM3);
+
+	timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIM3, rcc_apb1_frequency * 2 / 1000000 - 1);	/* 1MHz */
+	timer_set_period(TIM3, (1000000 + ADCSCAN_RATE_HZ * ADCSCAN_OVERSAMPLE / 2) / (ADCSCAN_RATE_HZ * ADCSCAN_OVERSAMPLE) - 1);
+	timer_set_master_mode(TIM3, TIM_CR2_MMS_UPDATE);
+	timer_enable_counter(TIM3);
+}
+
+/*
+ * Start the scan. Sets every axis range to 0..ADCSCAN_MAXIMUM, change
+ * them afterwards for calibrated limits.
+ */
+void
+adcscan_start(struct Joystick_ *js) {
+	uint8_t axis;
+
+	joystick = js;
+	usbhid_cycles_start();		/* tSTAB and stats.cycles_* */
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ ) {
+		Joystick_setAxisRange(js, axis, 0, ADCSCAN_MAXIMUM);
+		axisfilter_init(&filters[axis], ADCSCAN_FILTER_MEDIAN, ADCSCAN_FILTER_ALPHA);
+		axisfilter_set_deadband(&filters[axis], ADCSCAN_FILTER_HYSTERESIS, ADCSCAN_CENTER, ADCSCAN_FILTER_DEADZONE);
+		axisfilter_set_range(&filters[axis], 0, ADCSCAN_MAXIMUM);
+	}
+
+	adcscan_gpio_setup();
+	adcscan_dma_setup();
+	adcscan_adc_setup();
+	adcscan_timer_setup();		/* last: the first trigger starts the first scan */
+}
+
+// End adcscan.c
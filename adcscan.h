@@ -0,0 +1,113 @@
+/**
+ * adcscan.h
+ *
+ * Analog axes: ADC1 scans every axis channel on a TIM3 trigger, DMA
+ * stores the scans and each block of ADCSCAN_OVERSAMPLE scans updates all
+ * the joystick axes at once, from the DMA interrupt.
+ *
+ */
+
+#ifndef ADCSCAN_H
+#define ADCSCAN_H
+
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+
+#include "joystick.h"
+#include "axisfilter.h"
+
+/*
+ * ADC channel of each axis, in JOYSTICK_AXIS_* order.
+ * Channels 0..7 are PA0..PA7, 8 and 9 are PB0 and PB1.
+ */
+#ifndef ADCSCAN_CHANNELS
+#define ADCSCAN_CHANNELS 0, 1, 2, 3, 4, 5
+#endif
+
+#define ADCSCAN_CHANNEL_COUNT JOYSTICK_AXIS_COUNT
+
+/* Axis updates per second */
+#ifndef ADCSCAN_RATE_HZ
+#define ADCSCAN_RATE_HZ 1000
+#endif
+
+/*
+ * Scans per axis update: 1, 2, 4, 8 or 16. The scans are summed and
+ * decimated (boxcar, i.e. a first order CIC), which lowers the noise and
+ * adds a bit of resolution per factor 4: 12, 13 or 14 bit axis values.
+ */
+#ifndef ADCSCAN_OVERSAMPLE
+#define ADCSCAN_OVERSAMPLE 1
+#endif
+
+#if ADCSCAN_OVERSAMPLE == 1
+#define ADCSCAN_OVERSAMPLE_SHIFT 0
+#elif ADCSCAN_OVERSAMPLE == 2
+#define ADCSCAN_OVERSAMPLE_SHIFT 1
+#elif ADCSCAN_OVERSAMPLE == 4
+#define ADCSCAN_OVERSAMPLE_SHIFT 2
+#elif ADCSCAN_OVERSAMPLE == 8
+#define ADCSCAN_OVERSAMPLE_SHIFT 3
+#elif ADCSCAN_OVERSAMPLE == 16
+#define ADCSCAN_OVERSAMPLE_SHIFT 4
+#else
+#error "ADCSCAN_OVERSAMPLE must be 1, 2, 4, 8 or 16"
+#endif
+
+#define ADCSCAN_BITS            (12 + ADCSCAN_OVERSAMPLE_SHIFT / 2)
+#define ADCSCAN_MAXIMUM         ((1 << ADCSCAN_BITS) - 1)
+
+#if ADCSCAN_RATE_HZ < 16 || ADCSCAN_RATE_HZ * ADCSCAN_OVERSAMPLE > 20000
+#error "ADCSCAN_RATE_HZ * ADCSCAN_OVERSAMPLE must be between 16 and 20000 scans per second"
+#endif
+
+/*
+ * Filter every axis gets at start (see axisfilter.h), adcscan_set_filter()
+ * changes it per axis at run time. Default: none.
+ */
+#ifndef ADCSCAN_FILTER_MEDIAN
+#define ADCSCAN_FILTER_MEDIAN 0
+#endif
+
+#ifndef ADCSCAN_FILTER_ALPHA
+#define ADCSCAN_FILTER_ALPHA AXISFILTER_ALPHA_OFF
+#endif
+
+/*
+ * Deadband every axis gets at start, adcscan_set_deadband() changes it per
+ * axis at run time. Default: none; the center is mid range.
+ */
+#ifndef ADCSCAN_FILTER_HYSTERESIS
+#define ADCSCAN_FILTER_HYSTERESIS 0
+#endif
+
+#ifndef ADCSCAN_FILTER_DEADZONE
+#define ADCSCAN_FILTER_DEADZONE 0
+#endif
+
+#define ADCSCAN_CENTER ((ADCSCAN_MAXIMUM + 1) / 2)
+
+struct adcscan_stats {
+	uint32_t updates;		/* axis updates published */
+	uint32_t overruns;		/* blocks lost, the interrupt was too late */
+	uint32_t held;			/* axis changes absorbed by deadzone and hysteresis */
+	uint32_t cycles_last;		/* cycles to decimate, filter and publish one block */
+	uint32_t cycles_max;
+};
+
+void adcscan_start(struct Joystick_ *js);
+
+void adcscan_get_stats(struct adcscan_stats *stats);
+void adcscan_set_filter(uint8_t axis, uint8_t medianTaps, uint16_t alpha);
+void adcscan_set_deadband(uint8_t axis, uint16_t hysteresis, int16_t center, uint16_t deadzone);
+
+/*
+ * Decimates and filters one block of ADCSCAN_OVERSAMPLE scans (raw 12 bit
+ * samples, ADCSCAN_CHANNELS order) and pushes it into the joystick. This is what
+ * the DMA interrupt runs for every block; recorded buffers can be replayed
+ * through it.
+ */
+void adcscan_process(struct Joystick_ *js, const uint16_t block[ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT], BaseType_t *higherPriorityTaskWoken);
+
+#endif /* ADCSCAN_H */
@@ -0,0 +1,144 @@
+/**
+ * axisfilter.c
+ *
+ * See axisfilter.h
+ *
+ */
+
+#include <stdlib.h>
+
+#include "axisfilter.h"
+
+/**
+ * axisfilter_init
+ *
+ * Sets the filter up, see axisfilter_set_filter. No deadzone or
+ * hysteresis (axisfilter_set_deadband), and the whole int16 range
+ * (axisfilter_set_range).
+ *
+ */
+void axisfilter_init(struct axisfilter *f, uint8_t medianTaps, uint16_t alpha)
+{
+	f->_hysteresis = 0;
+	f->_center = 0;
+	f->_deadzone = 0;
+	f->_minimum = INT16_MIN;
+	f->_maximum = INT16_MAX;
+	f->_held = 0;
+	axisfilter_set_filter(f, medianTaps, alpha);
+}
+
+/**
+ * axisfilter_set_filter
+ *
+ * Changes the median and the IIR and forgets their history: the next
+ * value goes through unchanged. Median taps other than 3 or 5 turn the
+ * median off, an alpha of 0 or above AXISFILTER_ALPHA_OFF turns the IIR
+ * off. The deadband, the range and the held count are kept.
+ *
+ */
+void axisfilter_set_filter(struct axisfilter *f, uint8_t medianTaps, uint16_t alpha)
+{
+	f->_medianTaps = (medianTaps == 3 || medianTaps == 5) ? medianTaps : 0;
+	f->_alpha = (alpha == 0 || alpha > AXISFILTER_ALPHA_OFF) ? AXISFILTER_ALPHA_OFF : alpha;
+	f->_primed = false;
+	f->_next = 0;
+	f->_state = 0;
+	f->_output = 0;
+}
+
+/**
+ * axisfilter_set_deadband
+ *
+ * Values within deadzone of center become center (for sticks that do not
+ * return exactly to it). The output then only follows values that moved
+ * more than hysteresis away from it.
+ *
+ */
+void axisfilter_set_deadband(struct axisfilter *f, uint16_t hysteresis, int16_t center, uint16_t deadzone)
+{
+	f->_hysteresis = hysteresis;
+	f->_center = center;
+	f->_deadzone = deadzone;
+}
+
+/**
+ * axisfilter_set_range
+ *
+ * The end points of the input. Values at or beyond them always go
+ * through, whatever the hysteresis, so full travel is always reported.
+ *
+ */
+void axisfilter_set_range(struct axisfilter *f, int16_t minimum, int16_t maximum)
+{
+	f->_minimum = minimum;
+	f->_maximum = maximum;
+}
+
+static int16_t axisfilter_median(struct axisfilter *f, int16_t value)
+{
+	int16_t sorted[AXISFILTER_MEDIAN_MAX];
+	int16_t v;
+	uint8_t i, j;
+
+	f->_history[f->_next] = value;
+	if (++f->_next == f->_medianTaps)
+		f->_next = 0;
+
+	// insertion sort, at most 5 values
+	for (i = 0; i < f->_medianTaps; i++)
+	{
+		v = f->_history[i];
+		for (j = i; j > 0 && sorted[j - 1] > v; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = v;
+	}
+	return sorted[f->_medianTaps / 2];
+}
+
+/**
+ * axisfilter_apply
+ *
+ * Filters one sample. The IIR keeps its output with 15 fraction bits, so
+ * small steps are not lost, and rounds it to the nearest integer.
+ *
+ */
+int16_t axisfilter_apply(struct axisfilter *f, int16_t value)
+{
+	int16_t raw;
+	uint8_t i;
+
+	if (!f->_primed)
+	{
+		// start settled on the first value
+		for (i = 0; i < AXISFILTER_MEDIAN_MAX; i++)
+			f->_history[i] = value;
+		f->_state = (int32_t)value * 32768;
+		f->_output = value;
+		f->_primed = true;
+	}
+
+	if (f->_medianTaps)
+		value = axisfilter_median(f, value);
+
+	if (f->_alpha != AXISFILTER_ALPHA_OFF)
+	{
+		// the step spans up to 32 bits for a full scale int16 swing
+		f->_state += (int32_t)(((int64_t)f->_alpha * ((int64_t)value * 32768 - f->_state)) >> 15);
+		value = (int16_t)((f->_state + (1 << 14)) >> 15);
+	}
+
+	raw = value;
+	if (f->_deadzone && abs((int32_t)value - f->_center) <= f->_deadzone)
+		value = f->_center;
+
+	// the center and the end points are always reached exactly, whatever the hysteresis
+	if (value != f->_output
+	   && (abs((int32_t)value - f->_output) > f->_hysteresis || (f->_deadzone && value == f->_center)
+	       || value <= f->_minimum || value >= f->_maximum))
+		f->_output = value;
+	else if (raw != f->_output)
+		f->_held++;
+
+	return f->_output;
+}
@@ -0,0 +1,61 @@
+/**
+ * axisfilter.h
+ *
+ * Per axis filter stage between acquisition and the joystick:
+ * an optional 3 or 5 tap median (spike rejection) followed by a one-pole
+ * IIR low pass, y += alpha * (x - y), with alpha in Q15.
+ * Then a center deadzone, which snaps values near the center to it, and
+ * a hysteresis that holds the output until the value moves further than
+ * a threshold, so dithering LSBs do not produce new reports; the center
+ * and the end points of the range always go through.
+ * Fixed point only, no divide.
+ *
+ */
+
+#ifndef AXISFILTER_H
+#define AXISFILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AXISFILTER_MEDIAN_MAX   5
+
+/* alpha = 1.0: the IIR passes the input through */
+#define AXISFILTER_ALPHA_OFF    32768
+
+/*
+ * alpha for a cutoff of fc Hz at fs samples per second
+ * (2*pi*fc / (fs + 2*pi*fc), close to 1 - exp(-2*pi*fc/fs) for fc << fs)
+ */
+#define AXISFILTER_ALPHA(fc, fs) \
+	((uint16_t)(32768.0 * 6.283185307 * (fc) / ((fs) + 6.283185307 * (fc)) + 0.5))
+
+struct axisfilter
+{
+    //configuration
+	uint8_t   _medianTaps;		//0 (off), 3 or 5
+	uint16_t  _alpha;		//Q15, 1..AXISFILTER_ALPHA_OFF
+	uint16_t  _hysteresis;		//0 = off
+	int16_t   _center;
+	uint16_t  _deadzone;		//0 = off
+	int16_t   _minimum;
+	int16_t   _maximum;
+
+    //state
+	bool      _primed;
+	uint8_t   _next;
+	int16_t   _history[AXISFILTER_MEDIAN_MAX];
+	int32_t   _state;		//IIR output, Q15
+	int16_t   _output;
+
+    //changes absorbed by the deadzone and the hysteresis
+	uint32_t  _held;
+};
+
+void axisfilter_init(struct axisfilter *f, uint8_t medianTaps, uint16_t alpha);
+void axisfilter_set_filter(struct axisfilter *f, uint8_t medianTaps, uint16_t alpha);
+void axisfilter_set_deadband(struct axisfilter *f, uint16_t hysteresis, int16_t center, uint16_t deadzone);
+void axisfilter_set_range(struct axisfilter *f, int16_t minimum, int16_t maximum);
+int16_t axisfilter_apply(struct axisfilter *f, int16_t value);
+
+#endif /* AXISFILTER_H */
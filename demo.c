@@ -0,0 +1,56 @@
+/**
+ * demo.c
+ *
+ * Demo tasks, see demo.h
+ *
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "joystick.h"
+#include "demo.h"
+
+/**
+ * xAxis demo task
+ */
+void
+axis_demo_task(void *args) {
+	struct Joystick_ *joystick = args;
+	int value = 0;
+	int increment = 10;
+
+	for (;;) {
+		vTaskDelay(pdMS_TO_TICKS(100));
+		if(value > JOYSTICK_DEFAULT_AXIS_MAXIMUM || value < JOYSTICK_DEFAULT_AXIS_MINIMUM)
+			increment = -increment;
+
+		value += increment;
+
+		Joystick_setXAxis(joystick, value);
+	}
+}
+
+/**
+ * buttons demo task
+ */
+void
+buttons_demo_task(void *args) {
+	struct Joystick_ *joystick = args;
+	int8_t btn = 1;
+	int8_t next = 1;
+
+	for (;;) {
+		vTaskDelay(pdMS_TO_TICKS(500));
+		if(!(~btn))
+		{
+			next = 0;
+		}
+		if(!btn) next = 1;
+		btn = (btn<<1) | next;
+
+		Joystick_setButtons(joystick, btn);
+	}
+}
+
+// End demo.c
@@ -0,0 +1,18 @@
+/**
+ * demo.h
+ *
+ * Demo tasks of main.c, also run by host/usbhost. The task parameter is
+ * the struct Joystick_ they move.
+ *
+ */
+
+#ifndef DEMO_H
+#define DEMO_H
+
+/* xAxis moved back and forth, a step every 100ms */
+void axis_demo_task(void *args);
+
+/* buttons pressed every 500ms in a sequence, then released in a sequence */
+void buttons_demo_task(void *args);
+
+#endif // DEMO_H
@@ -0,0 +1,92 @@
+/**
+ * hidlayout.h
+ *
+ * Single description of the joystick input report.
+ * The HID report descriptor (usbhid.c), the report struct (joystick.h),
+ * the report size and every field offset are generated from it at build
+ * time, so they can not drift apart.
+ *
+ * Plain C preprocessor only: a host side decoder (C or C++) can include
+ * this header and use the same offsets.
+ *
+ */
+
+#ifndef HIDLAYOUT_H
+#define HIDLAYOUT_H
+
+#include <stdint.h>
+
+#define HID_REPORT_ID           0x03
+
+/* 1..128 buttons, can be overridden from the compiler command line */
+#ifndef HID_BUTTON_COUNT
+#define HID_BUTTON_COUNT           8
+#endif
+
+#if HID_BUTTON_COUNT < 1 || HID_BUTTON_COUNT > 128
+#error "HID_BUTTON_COUNT must be between 1 and 128"
+#endif
+
+/* 0..4 eight-way hat switches, a nibble each: 0 (up) .. 7 (up-left), 8 = centered */
+#ifndef HID_HAT_COUNT
+#define HID_HAT_COUNT              0
+#endif
+
+#if HID_HAT_COUNT < 0 || HID_HAT_COUNT > 4
+#error "HID_HAT_COUNT must be between 0 and 4"
+#endif
+
+#define HID_HAT_CENTERED           8
+
+/*
+ * Axes, in report order: AXIS(name, usage page, usage)
+ * Every axis is a 16 bit signed value, HID_AXIS_MINIMUM..HID_AXIS_MAXIMUM
+ */
+#define HID_AXES(AXIS) \
+	AXIS(X,           0x01, 0x30)  /* Generic Desktop: X */ \
+	AXIS(Y,           0x01, 0x31)  /* Generic Desktop: Y */ \
+	AXIS(Z,           0x01, 0x32)  /* Generic Desktop: Z */ \
+	AXIS(ACCELERATOR, 0x02, 0xC4)  /* Simulation Controls: Accelerator */ \
+	AXIS(BRAKE,       0x02, 0xC5)  /* Simulation Controls: Brake */ \
+	AXIS(STEERING,    0x02, 0xC8)  /* Simulation Controls: Steering */
+
+#define HID_AXIS_MINIMUM  -32767
+#define HID_AXIS_MAXIMUM   32767
+
+/* Derived sizes and offsets, all compile time constants */
+#define HID_COUNT_ONE(name, page, usage) +1
+#define HID_AXIS_COUNT          (0 HID_AXES(HID_COUNT_ONE))
+
+#define HID_BUTTON_BYTES        ((HID_BUTTON_COUNT + 7) / 8)
+#define HID_BUTTON_PADDING      (HID_BUTTON_BYTES * 8 - HID_BUTTON_COUNT)
+
+#define HID_HAT_BYTES           ((HID_HAT_COUNT + 1) / 2)
+
+#define HID_REPORT_BUTTONS_OFFSET   1
+#define HID_REPORT_HATS_OFFSET      (HID_REPORT_BUTTONS_OFFSET + HID_BUTTON_BYTES)
+#define HID_REPORT_AXIS_OFFSET(i)   (HID_REPORT_HATS_OFFSET + HID_HAT_BYTES + 2 * (i))
+#define HID_REPORT_SIZE             HID_REPORT_AXIS_OFFSET(HID_AXIS_COUNT)
+
+/* Report descriptor items for one axis (size, count and limits are global) */
+#define HID_DESCRIPTOR_AXIS(name, page, usage) \
+	0x05, page,     /* USAGE_PAGE */ \
+	0x09, usage,    /* USAGE */ \
+	0x81, 0x02,     /* INPUT (Data,Var,Abs) */
+
+/* Decoding helpers for host side tools */
+static inline int hid_report_button(const uint8_t *report, unsigned button)
+{
+	return (report[HID_REPORT_BUTTONS_OFFSET + button / 8] >> (button % 8)) & 1;
+}
+
+static inline int hid_report_hat(const uint8_t *report, unsigned hat)
+{
+	return (report[HID_REPORT_HATS_OFFSET + hat / 2] >> (4 * (hat % 2))) & 0x0F;
+}
+
+static inline int16_t hid_report_axis(const uint8_t *report, unsigned axis)
+{
+	return (int16_t)(report[HID_REPORT_AXIS_OFFSET(axis)] | (report[HID_REPORT_AXIS_OFFSET(axis) + 1] << 8));
+}
+
+#endif
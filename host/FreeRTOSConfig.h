@@ -0,0 +1,11 @@
+/* Host build
+ * The firmware's FreeRTOS configuration, with the host port: portmacro.h
+ * in this directory takes the place of the Cortex-M3 one.
+ */
+#ifndef HOST_FREERTOS_CONFIG_H
+#define HOST_FREERTOS_CONFIG_H
+
+#include "../FreeRTOSConfig.h"
+#include "portmacro.h"
+
+#endif /* HOST_FREERTOS_CONFIG_H */
@@ -0,0 +1,100 @@
+/* Host build
+ * Time to decimate, filter and set the axes from one block of
+ * ADCSCAN_OVERSAMPLE scans: adcscan_process() without USB, so the report
+ * is built but not queued. Run once without filters and once with a
+ * 5 tap median, the IIR and a hysteresis on every axis.
+ *
+ * Host nanoseconds: they rank the oversampling factors and the filters,
+ * the Cortex-M3 figure is adcscan_stats.cycles_* on the target.
+ *
+ * The filtered time is checked against the budget: one block may use
+ * BUDGET_PERCENT of its period at 72 MHz. Host nanoseconds are turned
+ * into target cycles assuming the Cortex-M3 takes TARGET_SLOWDOWN times
+ * longer than the host for the same code. Both can be given with -D.
+ * Exits with 1 when the estimate is over the budget.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+#include "../adcscan.h"
+
+#define BLOCKS		200000
+
+#ifndef BUDGET_PERCENT
+#define BUDGET_PERCENT		25
+#endif
+#ifndef TARGET_SLOWDOWN
+#define TARGET_SLOWDOWN		100
+#endif
+
+#define TARGET_HZ		72000000
+#define BUDGET_CYCLES		(TARGET_HZ / ADCSCAN_RATE_HZ * BUDGET_PERCENT / 100)
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+static uint16_t block[ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT];
+
+static uint64_t
+now_ns(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static double
+run(void) {
+	BaseType_t woken = pdFALSE;
+	uint32_t noise = 1;
+	uint64_t start, total = 0;
+	unsigned b, scan, ch;
+
+	for ( b = 0; b < BLOCKS; b++ ) {
+		for ( scan = 0; scan < ADCSCAN_OVERSAMPLE; scan++ )
+			for ( ch = 0; ch < ADCSCAN_CHANNEL_COUNT; ch++ ) {
+				noise = noise * 1103515245 + 12345;
+				block[scan][ch] = 2048 + (b & 0x3FF) + ((noise >> 16) & 7);
+			}
+		start = now_ns();
+		adcscan_process(&joystick, (const uint16_t (*)[ADCSCAN_CHANNEL_COUNT])block, &woken);
+		total += now_ns() - start;
+	}
+	return (double)total / BLOCKS;
+}
+
+int
+main(void) {
+	double plain, filtered;
+	uint32_t cycles;
+	uint8_t axis;
+
+	joystick_txq = xQueueCreate(USBHID_TXQ_LENGTH,sizeof(struct usbhid_frame));
+	Joystick_start(&joystick, &joystick_txq);
+	adcscan_start(&joystick);
+
+	plain = run();
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ ) {
+		adcscan_set_filter(axis, 5, AXISFILTER_ALPHA(20, ADCSCAN_RATE_HZ));
+		adcscan_set_deadband(axis, 4, ADCSCAN_CENTER, 0);
+	}
+	filtered = run();
+
+	cycles = (uint32_t)(filtered * TARGET_SLOWDOWN * (TARGET_HZ / 1e9));
+
+	printf("x%-2u %u axes: %6.1f ns per block, %5.2f ns per sample; filtered %6.1f ns per block; "
+		"about %u of %u cycles per block at %u Hz\n",
+		ADCSCAN_OVERSAMPLE, JOYSTICK_AXIS_COUNT, plain, plain / (ADCSCAN_OVERSAMPLE * ADCSCAN_CHANNEL_COUNT),
+		filtered, cycles, BUDGET_CYCLES, ADCSCAN_RATE_HZ);
+	if ( cycles > BUDGET_CYCLES ) {
+		printf("FAIL: over the budget, %u%% of the block period\n", BUDGET_PERCENT);
+		return 1;
+	}
+	return 0;
+}
+
+// End bench_adcscan.c
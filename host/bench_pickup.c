@@ -0,0 +1,147 @@
+/* Host build
+ * Time from a state change to the host reading its report, on the
+ * simulated single buffered endpoint with the report queue behind it,
+ * the host polling every USBHID_POLL_MS.
+ *
+ * sparse:   a change every 3.3 ms, at every phase of the poll interval
+ * per poll: a change every poll interval, half way between two polls
+ *
+ * Times are host microseconds, measured by the test around the setter
+ * and the IN token, plus the pickup usbhid_stats measures itself. The
+ * maximum mostly shows the host scheduler, the median and the 99th
+ * percentile the firmware.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define POLL_US		(USBHID_POLL_MS * 1000)
+#define CHANGES		300
+
+struct scenario {
+	const char *name;
+	uint32_t spacing_us;
+	uint32_t phase_us;
+};
+
+static const struct scenario scenarios[] = {
+	{ "sparse", 3300, 0 },
+	{ "per poll", POLL_US, POLL_US / 2 },
+};
+
+#define SCENARIOS	(sizeof(scenarios) / sizeof(scenarios[0]))
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static uint64_t set_us[SCENARIOS * CHANGES];
+static int16_t set_x[SCENARIOS * CHANGES];
+static uint64_t read_us[SCENARIOS * CHANGES];
+static volatile uint64_t start_us;		/* first poll of the session */
+static volatile bool producing = true;
+
+static void
+change_task(void *arg __attribute((unused))) {
+	struct Joystick_batch batch;
+	struct Joystick_report report;
+	uint64_t t;
+	unsigned s, i, n = 0;
+
+	while ( start_us == 0 )
+		vTaskDelay(1);
+	t = start_us + 10 * POLL_US;
+	for ( s = 0; s < SCENARIOS; s++ ) {
+		t += scenarios[s].phase_us;
+		for ( i = 0; i < CHANGES; i++, n++ ) {
+			host_sleep_until_us(t);
+			Joystick_beginUpdate(&joystick, &batch);	/* recorded before the host can read it */
+			Joystick_setXAxis(&joystick, n + 1);	/* 0 is the initial state */
+			Joystick_getReport(&joystick, &report);
+			set_x[n] = report.axis[JOYSTICK_AXIS_X];
+			set_us[n] = host_now_us();
+			Joystick_commit(&joystick, &batch);
+			t += scenarios[s].spacing_us;
+		}
+		t += 10 * POLL_US - scenarios[s].phase_us;	/* back in phase with the polls */
+		t -= (t - start_us) % POLL_US;
+	}
+	host_sleep_until_us(t);
+	producing = false;
+	vTaskDelay(portMAX_DELAY);
+}
+
+static int
+change_of(int16_t x) {
+	unsigned i;
+
+	for ( i = 0; i < SCENARIOS * CHANGES; i++ )
+		if ( set_x[i] == x && set_us[i] )
+			return i;
+	return -1;
+}
+
+static int
+compare_us(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int
+main(void) {
+	struct usbhid_stats stats;
+	uint8_t packet[64];
+	uint64_t next, pickup[CHANGES];
+	unsigned s, i, count;
+	int n;
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	xTaskCreate(change_task,"Change",configMINIMAL_STACK_SIZE,NULL,configMAX_PRIORITIES-1,NULL);
+
+	next = host_now_us();
+	start_us = next;
+	while ( producing ) {
+		host_sleep_until_us(next);
+		next += POLL_US;
+		if ( hostusb_in(0x81, packet) < 0 )
+			continue;
+		n = change_of(hid_report_axis(packet, JOYSTICK_AXIS_X));
+		if ( n >= 0 && read_us[n] == 0 )
+			read_us[n] = host_now_us();
+	}
+
+	printf("%s, poll every %u us, %u changes per scenario\n",
+		USBHID_TXQ_MAILBOX ? "mailbox" : "queue", POLL_US, CHANGES);
+	for ( s = 0; s < SCENARIOS; s++ ) {
+		count = 0;
+		for ( i = s * CHANGES; i < (s + 1) * CHANGES; i++ )
+			if ( read_us[i] )
+				pickup[count++] = read_us[i] - set_us[i];
+		if ( count == 0 )
+			continue;
+		qsort(pickup, count, sizeof(pickup[0]), compare_us);
+		printf("%-9s pickup median %5llu us, 99%% %5llu us, max %5llu us (%.2f, %.2f, %.2f polls), %u not read\n",
+			scenarios[s].name, (unsigned long long)pickup[count / 2],
+			(unsigned long long)pickup[count * 99 / 100], (unsigned long long)pickup[count - 1],
+			(double)pickup[count / 2] / POLL_US, (double)pickup[count * 99 / 100] / POLL_US,
+			(double)pickup[count - 1] / POLL_US, CHANGES - count);
+	}
+	usbhid_get_stats(&stats);
+	printf("usbhid_stats: latency max %u us, pickup max %u us, frames sent %u, dropped %u, coalesced %u\n",
+		stats.latency_max / (rcc_ahb_frequency / 1000000), stats.pickup_max / (rcc_ahb_frequency / 1000000),
+		stats.frames_sent, stats.frames_dropped, stats.frames_coalesced);
+	return stats.frames_sent == 0;
+}
+
+// End bench_pickup.c
@@ -0,0 +1,120 @@
+/* Host build
+ * Queue operations and time per report, producer to endpoint.
+ *
+ * before: the transport usbhid.c and joystick.c used to have, replayed on
+ *         the same RTOS layer: a 128 x 1 byte queue, one xQueueSend per
+ *         report byte, one xQueueReceive per byte in usb_task.
+ * after:  Joystick_setXAxis() through usb_task to the host, one whole
+ *         report per queue item.
+ *
+ * The time is what the producer spends per report, in host nanoseconds.
+ * After includes waking usb_task, a thread switch here, and every queue
+ * call costs a lock and a wake up on the host, so the counts are what
+ * carries over to the target.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define REPORTS		20000
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static uint64_t
+now_ns(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void
+print_line(const char *name, const struct host_rtos_stats *a, const struct host_rtos_stats *b, uint64_t ns) {
+	printf("%-7s %5.1f sends %5.1f receives %5.1f peeks per report, producer %6.0f ns\n", name,
+		(double)(b->queue_sends - a->queue_sends) / REPORTS,
+		(double)(b->queue_receives - a->queue_receives) / REPORTS,
+		(double)(b->queue_peeks - a->queue_peeks) / REPORTS,
+		(double)ns / REPORTS);
+}
+
+/*
+ * The old transport, producer and consumer in turn
+ */
+static void
+bench_bytes(void) {
+	QueueHandle_t q = xQueueCreate(128, sizeof(uint8_t));
+	struct host_rtos_stats a, b;
+	uint8_t report[PACKET_SIZE], packet[PACKET_SIZE];
+	uint64_t producer = 0, t;
+	unsigned i, n;
+
+	memset(report, 0, sizeof(report));
+	host_get_rtos_stats(&a);
+	for ( i = 0; i < REPORTS; i++ ) {
+		report[HID_REPORT_AXIS_OFFSET(0)] = i;
+		t = now_ns();
+		for ( n = 0; n < PACKET_SIZE; n++ )		/* Joystick_sendState */
+			xQueueSend(q, &report[n], 0);
+		producer += now_ns() - t;
+		for ( n = 0; n < PACKET_SIZE; n++ )		/* usb_task */
+			xQueueReceive(q, &packet[n], 0);
+	}
+	host_get_rtos_stats(&b);
+	print_line("before", &a, &b, producer);
+}
+
+/*
+ * The report queue, through usb_task and the endpoint to the host
+ */
+static int
+bench_frames(void) {
+	struct host_rtos_stats a, b;
+	struct usbhid_stats stats;
+	uint8_t packet[64];
+	uint64_t producer = 0, t;
+	unsigned i, spins;
+
+	host_get_rtos_stats(&a);
+	for ( i = 0; i < REPORTS; i++ ) {
+		t = now_ns();
+		Joystick_setXAxis(&joystick, i % 4000);		/* a new report every time */
+		producer += now_ns() - t;
+		for ( spins = 0; hostusb_in(0x81, packet) < 0; spins++ ) {
+			if ( spins > 1000000 ) {
+				fprintf(stderr, "report %u never reached the host\n", i);
+				return 1;
+			}
+			sched_yield();
+		}
+	}
+	host_get_rtos_stats(&b);
+	print_line("after", &a, &b, producer);
+
+	usbhid_get_stats(&stats);
+	printf("frames sent %u, dropped %u, partial %u\n", stats.frames_sent, stats.frames_dropped, stats.frames_partial);
+	return stats.frames_dropped != 0 || stats.frames_partial != 0;
+}
+
+int
+main(void) {
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+
+	printf("%u reports of %u bytes\n", REPORTS, PACKET_SIZE);
+	bench_bytes();
+	return bench_frames();
+}
+
+// End bench_queue.c
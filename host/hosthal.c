@@ -0,0 +1,156 @@
+/* Host build
+ * The libopencm3 calls the firmware makes: clock, pin and peripheral
+ * setup do nothing, the NVIC remembers which interrupts are enabled and
+ * the DWT cycle counter runs at 72 MHz on the host clock, from where
+ * dwt_enable_cycle_counter() last zeroed it.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+
+#include "hostrtos.h"
+
+uint32_t rcc_ahb_frequency = 72000000;
+uint32_t rcc_apb1_frequency = 36000000;
+uint32_t rcc_apb2_frequency = 72000000;
+
+volatile uint32_t host_adc_dr[1];
+volatile uint32_t host_dma_flags;
+
+static volatile uint8_t irq_enabled[NVIC_IRQ_COUNT];
+
+/*
+ * RCC
+ */
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void) { }
+void rcc_periph_clock_enable(enum rcc_periph_clken clken __attribute((unused))) { }
+void rcc_periph_reset_pulse(enum rcc_periph_rst rst __attribute((unused))) { }
+void rcc_set_adcpre(uint32_t adcpre __attribute((unused))) { }
+
+/*
+ * GPIO
+ */
+void gpio_set_mode(uint32_t gpioport __attribute((unused)), uint8_t mode __attribute((unused)),
+	uint8_t cnf __attribute((unused)), uint16_t gpios __attribute((unused))) { }
+void gpio_set(uint32_t gpioport __attribute((unused)), uint16_t gpios __attribute((unused))) { }
+void gpio_clear(uint32_t gpioport __attribute((unused)), uint16_t gpios __attribute((unused))) { }
+
+/*
+ * ADC
+ */
+void adc_power_on(uint32_t adc __attribute((unused))) { }
+void adc_power_off(uint32_t adc __attribute((unused))) { }
+void adc_set_dual_mode(uint32_t mode __attribute((unused))) { }
+void adc_enable_scan_mode(uint32_t adc __attribute((unused))) { }
+void adc_set_single_conversion_mode(uint32_t adc __attribute((unused))) { }
+void adc_set_right_aligned(uint32_t adc __attribute((unused))) { }
+void adc_set_sample_time_on_all_channels(uint32_t adc __attribute((unused)), uint8_t time __attribute((unused))) { }
+void adc_set_regular_sequence(uint32_t adc __attribute((unused)), uint8_t length __attribute((unused)),
+	uint8_t channel[] __attribute((unused))) { }
+void adc_enable_external_trigger_regular(uint32_t adc __attribute((unused)), uint32_t trigger __attribute((unused))) { }
+void adc_enable_dma(uint32_t adc __attribute((unused))) { }
+void adc_reset_calibration(uint32_t adc __attribute((unused))) { }
+void adc_calibrate(uint32_t adc __attribute((unused))) { }
+
+/*
+ * DMA: a test sets host_dma_flags and runs dma1_channel1_isr()
+ */
+void dma_channel_reset(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_set_peripheral_address(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint32_t address __attribute((unused))) { }
+void dma_set_memory_address(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint32_t address __attribute((unused))) { }
+void dma_set_number_of_data(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint16_t number __attribute((unused))) { }
+void dma_set_read_from_peripheral(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_enable_memory_increment_mode(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_set_peripheral_size(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint32_t peripheral_size __attribute((unused))) { }
+void dma_set_memory_size(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint32_t mem_size __attribute((unused))) { }
+void dma_enable_circular_mode(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_set_priority(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)),
+	uint32_t prio __attribute((unused))) { }
+void dma_enable_half_transfer_interrupt(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_enable_transfer_complete_interrupt(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+void dma_enable_channel(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused))) { }
+
+bool
+dma_get_interrupt_flag(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)), uint32_t interrupts) {
+	return (host_dma_flags & interrupts) != 0;
+}
+
+void
+dma_clear_interrupt_flags(uint32_t dma __attribute((unused)), uint8_t channel __attribute((unused)), uint32_t interrupts) {
+	host_dma_flags &= ~interrupts;
+}
+
+/*
+ * Timers
+ */
+void timer_set_mode(uint32_t timer_peripheral __attribute((unused)), uint32_t clock_div __attribute((unused)),
+	uint32_t alignment __attribute((unused)), uint32_t direction __attribute((unused))) { }
+void timer_set_prescaler(uint32_t timer_peripheral __attribute((unused)), uint32_t value __attribute((unused))) { }
+void timer_set_period(uint32_t timer_peripheral __attribute((unused)), uint32_t period __attribute((unused))) { }
+void timer_set_master_mode(uint32_t timer_peripheral __attribute((unused)), uint32_t mode __attribute((unused))) { }
+void timer_enable_counter(uint32_t timer_peripheral __attribute((unused))) { }
+
+/*
+ * NVIC
+ */
+void
+nvic_enable_irq(uint8_t irqn) {
+	if ( irqn < NVIC_IRQ_COUNT )
+		irq_enabled[irqn] = 1;
+}
+
+void
+nvic_disable_irq(uint8_t irqn) {
+	if ( irqn < NVIC_IRQ_COUNT )
+		irq_enabled[irqn] = 0;
+}
+
+void nvic_set_priority(uint8_t irqn __attribute((unused)), uint8_t priority __attribute((unused))) { }
+
+uint8_t
+nvic_get_irq_enabled(uint8_t irqn) {
+	return irqn < NVIC_IRQ_COUNT && irq_enabled[irqn];
+}
+
+/*
+ * DWT
+ */
+uint32_t host_dwt_ctrl, host_scs_demcr;
+static uint64_t cycle_base_us;
+static uint32_t cycle_resets;
+
+bool
+dwt_enable_cycle_counter(void) {
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	cycle_base_us = host_now_us();		/* DWT_CYCCNT = 0 */
+	++cycle_resets;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	return true;
+}
+
+uint32_t
+dwt_read_cycle_counter(void) {
+	if ( !(SCS_DEMCR & SCS_DEMCR_TRCENA) || !(DWT_CTRL & DWT_CTRL_CYCCNTENA) )
+		return 0;
+	return (uint32_t)((host_now_us() - cycle_base_us) * (rcc_ahb_frequency / 1000000));
+}
+
+uint32_t
+dwt_get_resets(void) {
+	return cycle_resets;
+}
+
+// End hosthal.c
@@ -0,0 +1,391 @@
+/* Host build
+ * FreeRTOS API on POSIX threads, see hostrtos.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <libopencm3/cm3/scb.h>
+
+#include "hostrtos.h"
+
+struct tskTaskControlBlock {
+	pthread_t thread;
+	TaskFunction_t code;
+	void *parameters;
+	uint32_t notify;
+};
+
+struct QueueDefinition {
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t head;
+	UBaseType_t count;
+	uint8_t *storage;
+};
+
+/*
+ * The interrupt mask, and the condition every blocked task waits on:
+ * any queue or notification change wakes all of them to check again
+ */
+static pthread_mutex_t mask;
+static pthread_cond_t changed;
+static struct timespec start;
+static __thread TaskHandle_t current;
+__thread uint32_t host_scb_icsr;	/* see libopencm3/cm3/scb.h */
+static struct host_rtos_stats stats;
+
+__attribute__((constructor)) static void
+host_init(void) {
+	pthread_mutexattr_t attr;
+	pthread_condattr_t cattr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mask, &attr);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&changed, &cattr);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+uint64_t
+host_now_us(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static struct timespec
+host_abs_time(uint64_t us) {
+	struct timespec t = start;
+
+	t.tv_sec += us / 1000000;
+	t.tv_nsec += (us % 1000000) * 1000;
+	if ( t.tv_nsec >= 1000000000 ) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	}
+	return t;
+}
+
+void
+host_sleep_until_us(uint64_t us) {
+	struct timespec t = host_abs_time(us);
+
+	while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR )
+		;
+}
+
+void
+host_interrupt(void (*isr)(void)) {
+	uint32_t interrupted;
+
+	pthread_mutex_lock(&mask);
+	interrupted = host_scb_icsr;
+	host_scb_icsr = HOST_INTERRUPT_VECTOR;
+	isr();
+	host_scb_icsr = interrupted;
+	pthread_mutex_unlock(&mask);
+}
+
+void
+host_get_rtos_stats(struct host_rtos_stats *s) {
+	pthread_mutex_lock(&mask);
+	*s = stats;
+	pthread_mutex_unlock(&mask);
+}
+
+/*
+ * Critical sections
+ */
+UBaseType_t
+ulPortRaiseMask(void) {
+	pthread_mutex_lock(&mask);
+	++stats.critical_sections;
+	return 0;
+}
+
+void
+vPortSetMask(UBaseType_t previous __attribute((unused))) {
+	pthread_mutex_unlock(&mask);
+}
+
+void
+vPortYield(void) {
+	sched_yield();
+}
+
+/*
+ * Blocks, with the mask held, until ready() or the timeout.
+ * Returns ready().
+ */
+static bool
+host_wait(bool (*ready)(void *), void *arg, TickType_t ticks) {
+	struct timespec deadline;
+
+	if ( ticks != portMAX_DELAY )
+		deadline = host_abs_time(host_now_us() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+	while ( !ready(arg) ) {
+		if ( ticks == 0 )
+			return false;
+		if ( ticks == portMAX_DELAY )
+			pthread_cond_wait(&changed, &mask);
+		else if ( pthread_cond_timedwait(&changed, &mask, &deadline) == ETIMEDOUT )
+			return ready(arg);
+	}
+	return true;
+}
+
+/*
+ * Ticks
+ */
+TickType_t
+xTaskGetTickCount(void) {
+	return (TickType_t)(host_now_us() / (1000 * portTICK_PERIOD_MS));
+}
+
+TickType_t
+xTaskGetTickCountFromISR(void) {
+	return xTaskGetTickCount();
+}
+
+void
+vTaskDelay(const TickType_t ticks) {
+	host_sleep_until_us(host_now_us() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+void
+vTaskDelayUntil(TickType_t * const previous, const TickType_t increment) {
+	*previous += increment;
+	host_sleep_until_us((uint64_t)*previous * portTICK_PERIOD_MS * 1000);
+}
+
+/*
+ * Tasks
+ */
+static void *
+host_task(void *arg) {
+	TaskHandle_t task = arg;
+
+	current = task;
+	task->code(task->parameters);
+	return NULL;
+}
+
+TaskHandle_t
+xTaskGetCurrentTaskHandle(void) {
+	return current;			/* NULL outside the tasks */
+}
+
+BaseType_t
+xTaskCreate(TaskFunction_t code, const char * const name __attribute((unused)),
+	const configSTACK_DEPTH_TYPE depth __attribute((unused)), void * const parameters,
+	UBaseType_t priority __attribute((unused)), TaskHandle_t * const created) {
+	TaskHandle_t task = calloc(1, sizeof(*task));
+
+	if ( task == NULL )
+		return errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY;
+	task->code = code;
+	task->parameters = parameters;
+	if ( created )
+		*created = task;		/* before the task can use it */
+	if ( pthread_create(&task->thread, NULL, host_task, task) != 0 )
+		return errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY;
+	pthread_detach(task->thread);
+	return pdPASS;
+}
+
+/*
+ * Direct to task notifications, as a counting semaphore
+ */
+static bool
+host_notified(void *arg) {
+	return ((TaskHandle_t)arg)->notify != 0;
+}
+
+uint32_t
+ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+	uint32_t value;
+
+	pthread_mutex_lock(&mask);
+	host_wait(host_notified, current, ticks);
+	value = current->notify;
+	if ( value )
+		current->notify = clear ? 0 : value - 1;
+	pthread_mutex_unlock(&mask);
+	return value;
+}
+
+void
+vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+	pthread_mutex_lock(&mask);
+	task->notify++;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mask);
+	if ( woken )
+		*woken = pdTRUE;
+}
+
+/*
+ * Queues
+ */
+QueueHandle_t
+xQueueGenericCreate(const UBaseType_t length, const UBaseType_t item_size, const uint8_t type __attribute((unused))) {
+	QueueHandle_t q = calloc(1, sizeof(*q));
+
+	if ( q == NULL )
+		return NULL;
+	q->length = length;
+	q->item_size = item_size;
+	q->storage = calloc(length, item_size);
+	if ( q->storage == NULL ) {
+		free(q);
+		return NULL;
+	}
+	return q;
+}
+
+static bool
+host_has_space(void *arg) {
+	QueueHandle_t q = arg;
+
+	return q->count < q->length;
+}
+
+static bool
+host_has_item(void *arg) {
+	return ((QueueHandle_t)arg)->count != 0;
+}
+
+/* With the mask held */
+static BaseType_t
+host_queue_put(QueueHandle_t q, const void *item, BaseType_t position, TickType_t ticks) {
+	++stats.queue_sends;
+	if ( position == queueOVERWRITE ) {
+		q->head = 0;
+		q->count = 0;
+	} else if ( !host_wait(host_has_space, q, ticks) ) {
+		return errQUEUE_FULL;
+	}
+
+	if ( position == queueSEND_TO_FRONT ) {
+		q->head = (q->head + q->length - 1) % q->length;
+		memcpy(q->storage + q->head * q->item_size, item, q->item_size);
+	} else {
+		memcpy(q->storage + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+	}
+	q->count++;
+	pthread_cond_broadcast(&changed);
+	return pdPASS;
+}
+
+/* With the mask held */
+static BaseType_t
+host_queue_get(QueueHandle_t q, void *buffer, bool remove, TickType_t ticks) {
+	if ( remove )
+		++stats.queue_receives;
+	else
+		++stats.queue_peeks;
+	if ( !host_wait(host_has_item, q, ticks) )
+		return errQUEUE_EMPTY;
+
+	memcpy(buffer, q->storage + q->head * q->item_size, q->item_size);
+	if ( remove ) {
+		q->head = (q->head + 1) % q->length;
+		q->count--;
+		pthread_cond_broadcast(&changed);
+	}
+	return pdPASS;
+}
+
+BaseType_t
+xQueueGenericSend(QueueHandle_t q, const void * const item, TickType_t ticks, const BaseType_t position) {
+	BaseType_t result;
+
+	pthread_mutex_lock(&mask);
+	result = host_queue_put(q, item, position, ticks);
+	pthread_mutex_unlock(&mask);
+	return result;
+}
+
+BaseType_t
+xQueueGenericSendFromISR(QueueHandle_t q, const void * const item, BaseType_t * const woken, const BaseType_t position) {
+	BaseType_t result;
+
+	pthread_mutex_lock(&mask);
+	result = host_queue_put(q, item, position, 0);
+	pthread_mutex_unlock(&mask);
+	if ( result == pdPASS && woken )
+		*woken = pdTRUE;
+	return result;
+}
+
+BaseType_t
+xQueueReceive(QueueHandle_t q, void * const buffer, TickType_t ticks) {
+	BaseType_t result;
+
+	pthread_mutex_lock(&mask);
+	result = host_queue_get(q, buffer, true, ticks);
+	pthread_mutex_unlock(&mask);
+	return result;
+}
+
+BaseType_t
+xQueueReceiveFromISR(QueueHandle_t q, void * const buffer, BaseType_t * const woken) {
+	BaseType_t result = xQueueReceive(q, buffer, 0);
+
+	if ( result == pdPASS && woken )
+		*woken = pdTRUE;
+	return result;
+}
+
+BaseType_t
+xQueuePeek(QueueHandle_t q, void * const buffer, TickType_t ticks) {
+	BaseType_t result;
+
+	pthread_mutex_lock(&mask);
+	result = host_queue_get(q, buffer, false, ticks);
+	pthread_mutex_unlock(&mask);
+	return result;
+}
+
+BaseType_t
+xQueuePeekFromISR(QueueHandle_t q, void * const buffer) {
+	return xQueuePeek(q, buffer, 0);
+}
+
+UBaseType_t
+uxQueueMessagesWaiting(const QueueHandle_t q) {
+	UBaseType_t count;
+
+	pthread_mutex_lock(&mask);
+	count = q->count;
+	pthread_mutex_unlock(&mask);
+	return count;
+}
+
+UBaseType_t
+uxQueueMessagesWaitingFromISR(const QueueHandle_t q) {
+	return uxQueueMessagesWaiting(q);
+}
+
+BaseType_t
+xQueueGenericReset(QueueHandle_t q, BaseType_t new_queue __attribute((unused))) {
+	pthread_mutex_lock(&mask);
+	q->head = 0;
+	q->count = 0;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mask);
+	return pdPASS;
+}
+
+// End hostrtos.c
@@ -0,0 +1,40 @@
+/* Host build
+ * FreeRTOS on POSIX threads, the subset the firmware uses: tasks,
+ * queues, direct to task notifications, delays and critical sections.
+ *
+ * Tasks are threads and run in parallel, priorities are not modelled.
+ * The interrupt mask is one recursive lock: taskENTER_CRITICAL() and the
+ * FromISR mask take it, and so does host_interrupt() for the whole of a
+ * simulated interrupt handler, so handlers and critical sections exclude
+ * each other as they do under BASEPRI on the target.
+ * Ticks are real milliseconds since the program started.
+ */
+#ifndef HOSTRTOS_H
+#define HOSTRTOS_H
+
+#include <stdint.h>
+
+/* Microseconds since the program started */
+uint64_t host_now_us(void);
+
+/* Sleeps until host_now_us() reaches us */
+void host_sleep_until_us(uint64_t us);
+
+/*
+ * Runs an interrupt handler with the interrupt mask held. Handlers never
+ * preempt each other here, so they all run as one exception number.
+ */
+#define HOST_INTERRUPT_VECTOR	16
+void host_interrupt(void (*isr)(void));
+
+/* Calls made so far, for the benchmarks */
+struct host_rtos_stats {
+	uint32_t queue_sends;		/* xQueueSend, xQueueOverwrite and their FromISR */
+	uint32_t queue_receives;	/* xQueueReceive(FromISR) */
+	uint32_t queue_peeks;		/* xQueuePeek(FromISR) */
+	uint32_t critical_sections;	/* taskENTER_CRITICAL and the FromISR mask */
+};
+
+void host_get_rtos_stats(struct host_rtos_stats *stats);
+
+#endif /* HOSTRTOS_H */
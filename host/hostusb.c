@@ -0,0 +1,457 @@
+/* Host build
+ * A simulated STM32 USB device behind the libopencm3 usbd API, see
+ * hostusb.h. It does what the stack in libopencm3 does for the firmware:
+ * the control requests go to the registered callbacks first, one that
+ * handles or stalls the request ends the dispatch, then the standard
+ * requests are answered from the descriptors; SET_CONFIGURATION drops
+ * the class callbacks before it calls the set config callback.
+ * The report endpoint is single buffered like the STM32F1 interrupt
+ * endpoints: a write fails while the host has not read the last packet.
+ * hostusb_start_joystick() brings the firmware up on it as main() does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define HOSTUSB_CALLBACKS	4
+#define HOSTUSB_PACKET_MAX	64
+
+struct _usbd_driver {
+	const char *name;
+};
+
+const usbd_driver host_usb_driver = { .name = "host" };
+
+struct hostusb_endpoint {
+	bool configured;
+	bool valid;			/* holds a packet the host has not read */
+	uint16_t max_size;
+	uint16_t len;
+	uint8_t data[HOSTUSB_PACKET_MAX];
+	usbd_endpoint_callback callback;
+};
+
+struct _usbd_device {
+	const struct usb_device_descriptor *dev;
+	const struct usb_config_descriptor *config;
+	const char * const *strings;
+	int num_strings;
+	uint8_t *control_buffer;
+	uint16_t control_buffer_size;
+
+	struct {
+		uint8_t type;
+		uint8_t type_mask;
+		usbd_control_callback cb;
+	} control_callback[HOSTUSB_CALLBACKS];
+	usbd_set_config_callback set_config;
+	void (*reset)(void);
+
+	struct hostusb_endpoint in;	/* 0x81 */
+};
+
+extern void usb_lp_can_rx0_isr(void);
+
+static usbd_device device;
+static volatile bool attached = false;
+static pthread_mutex_t sie = PTHREAD_MUTEX_INITIALIZER;	/* the packet memory, shared by CPU and bus */
+
+/*
+ * Events for usbd_poll(), set by the bus side before it raises the
+ * interrupt
+ */
+static struct {
+	bool reset;
+	bool setup;
+	bool in_complete;
+	struct usb_setup_data req;
+	uint8_t *data;
+	int result;
+} event;
+
+/*
+ * Device side: the libopencm3 API
+ */
+usbd_device *
+usbd_init(const usbd_driver *driver __attribute((unused)),
+		const struct usb_device_descriptor *dev,
+		const struct usb_config_descriptor *conf,
+		const char * const *strings, int num_strings,
+		uint8_t *control_buffer, uint16_t control_buffer_size) {
+	memset(&device, 0, sizeof(device));
+	device.dev = dev;
+	device.config = conf;
+	device.strings = strings;
+	device.num_strings = num_strings;
+	device.control_buffer = control_buffer;
+	device.control_buffer_size = control_buffer_size;
+	attached = true;		/* the peripheral takes D+ over */
+	return &device;
+}
+
+void
+usbd_register_reset_callback(usbd_device *dev, void (*callback)(void)) {
+	dev->reset = callback;
+}
+
+int
+usbd_register_control_callback(usbd_device *dev, uint8_t type, uint8_t type_mask, usbd_control_callback callback) {
+	int i;
+
+	for ( i = 0; i < HOSTUSB_CALLBACKS; i++ ) {
+		if ( dev->control_callback[i].cb )
+			continue;
+		dev->control_callback[i].type = type;
+		dev->control_callback[i].type_mask = type_mask;
+		dev->control_callback[i].cb = callback;
+		return 0;
+	}
+	return -1;
+}
+
+int
+usbd_register_set_config_callback(usbd_device *dev, usbd_set_config_callback callback) {
+	dev->set_config = callback;
+	return 0;
+}
+
+void
+usbd_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type __attribute((unused)),
+		uint16_t max_size, usbd_endpoint_callback callback) {
+	if ( addr != 0x81 )
+		return;
+	pthread_mutex_lock(&sie);
+	dev->in.configured = true;
+	dev->in.valid = false;
+	dev->in.max_size = max_size;
+	dev->in.callback = callback;
+	pthread_mutex_unlock(&sie);
+}
+
+uint16_t
+usbd_ep_write_packet(usbd_device *dev, uint8_t addr, const void *buf, uint16_t len) {
+	struct hostusb_endpoint *ep = &dev->in;
+
+	if ( addr != 0x81 )
+		return 0;
+	pthread_mutex_lock(&sie);
+	if ( !ep->configured || ep->valid ) {
+		pthread_mutex_unlock(&sie);
+		return 0;
+	}
+	if ( len > ep->max_size )
+		len = ep->max_size;
+	memcpy(ep->data, buf, len);
+	ep->len = len;
+	ep->valid = true;
+	pthread_mutex_unlock(&sie);
+	return len;
+}
+
+/*
+ * Config descriptor with its interfaces, class descriptors and endpoints,
+ * as libopencm3 builds it. Returns the total length.
+ */
+static uint16_t
+hostusb_build_config(uint8_t *buf, uint16_t size) {
+	const struct usb_config_descriptor *cfg = device.config;
+	struct usb_config_descriptor head;
+	uint8_t tmp[512];
+	uint16_t total = cfg->bLength;
+	uint8_t i, a, e;
+
+	for ( i = 0; i < cfg->bNumInterfaces; i++ ) {
+		for ( a = 0; a < cfg->interface[i].num_altsetting; a++ ) {
+			const struct usb_interface_descriptor *iface = &cfg->interface[i].altsetting[a];
+
+			memcpy(tmp + total, iface, iface->bLength);
+			total += iface->bLength;
+			memcpy(tmp + total, iface->extra, iface->extralen);
+			total += iface->extralen;
+			for ( e = 0; e < iface->bNumEndpoints; e++ ) {
+				memcpy(tmp + total, &iface->endpoint[e], iface->endpoint[e].bLength);
+				total += iface->endpoint[e].bLength;
+			}
+		}
+	}
+	memcpy(&head, cfg, cfg->bLength);
+	head.wTotalLength = total;
+	memcpy(tmp, &head, cfg->bLength);
+	memcpy(buf, tmp, total < size ? total : size);
+	return total;
+}
+
+/*
+ * Standard requests to the device, after the callbacks passed.
+ * Returns the answer length or -1 to stall.
+ */
+static int
+hostusb_standard_request(struct usb_setup_data *req, uint8_t *buf) {
+	uint8_t index = req->wValue & 0xFF;
+	int len, i;
+	const char *s;
+
+	if ( (req->bmRequestType & (USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT)) != (USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE) )
+		return -1;
+
+	switch ( req->bRequest ) {
+	case USB_REQ_GET_DESCRIPTOR:
+		switch ( req->wValue >> 8 ) {
+		case USB_DT_DEVICE:
+			memcpy(buf, device.dev, USB_DT_DEVICE_SIZE);
+			return USB_DT_DEVICE_SIZE;
+		case USB_DT_CONFIGURATION:
+			return hostusb_build_config(buf, device.control_buffer_size);
+		case USB_DT_STRING:
+			if ( index == 0 ) {
+				buf[0] = 4;
+				buf[1] = USB_DT_STRING;
+				buf[2] = 0x09;		/* English (US) */
+				buf[3] = 0x04;
+				return 4;
+			}
+			if ( index > device.num_strings )
+				return -1;
+			s = device.strings[index - 1];
+			len = 2;
+			for ( i = 0; s[i] && len + 2 <= device.control_buffer_size; i++, len += 2 ) {
+				buf[len] = s[i];
+				buf[len + 1] = 0;
+			}
+			buf[0] = len;
+			buf[1] = USB_DT_STRING;
+			return len;
+		}
+		return -1;
+
+	case USB_REQ_SET_ADDRESS:
+		return 0;
+
+	case USB_REQ_SET_CONFIGURATION:
+		if ( index != device.config->bConfigurationValue )
+			return -1;
+		memset(device.control_callback, 0, sizeof(device.control_callback));
+		if ( device.set_config )
+			device.set_config(&device, req->wValue);
+		return 0;
+
+	case USB_REQ_GET_CONFIGURATION:
+		buf[0] = device.config->bConfigurationValue;
+		return 1;
+	}
+	return -1;
+}
+
+/*
+ * Returns the answer length, with the answer in *buf, or -1 to stall
+ */
+static int
+hostusb_control_request(struct usb_setup_data *req, uint8_t **buf) {
+	uint16_t len = req->wLength;
+	usbd_control_complete_callback complete = NULL;
+	enum usbd_request_return_codes result;
+	int i;
+
+	*buf = device.control_buffer;
+	for ( i = 0; i < HOSTUSB_CALLBACKS; i++ ) {
+		if ( !device.control_callback[i].cb
+		  || (req->bmRequestType & device.control_callback[i].type_mask) != device.control_callback[i].type )
+			continue;
+		result = device.control_callback[i].cb(&device, req, buf, &len, &complete);
+		if ( result == USBD_REQ_NOTSUPP )
+			return -1;
+		if ( result == USBD_REQ_HANDLED ) {
+			if ( complete )
+				complete(&device, req);
+			return len;
+		}
+	}
+	return hostusb_standard_request(req, *buf);
+}
+
+void
+usbd_poll(usbd_device *dev) {
+	uint8_t *buf;
+
+	if ( event.reset ) {
+		event.reset = false;
+		pthread_mutex_lock(&sie);
+		dev->in.configured = false;
+		dev->in.valid = false;
+		pthread_mutex_unlock(&sie);
+		if ( dev->reset )
+			dev->reset();
+	}
+	if ( event.setup ) {
+		event.setup = false;
+		if ( !(event.req.bmRequestType & USB_REQ_TYPE_IN) && event.req.wLength )
+			memcpy(dev->control_buffer, event.data, event.req.wLength);
+		event.result = hostusb_control_request(&event.req, &buf);
+		if ( event.result > event.req.wLength )
+			event.result = event.req.wLength;
+		if ( event.result > 0 && (event.req.bmRequestType & USB_REQ_TYPE_IN) )
+			memcpy(event.data, buf, event.result);
+	}
+	if ( event.in_complete ) {
+		event.in_complete = false;
+		if ( dev->in.callback )
+			dev->in.callback(dev, 0x81);
+	}
+}
+
+/*
+ * Bus side
+ */
+static bool
+hostusb_interrupt(void) {
+	if ( !attached || !nvic_get_irq_enabled(NVIC_USB_LP_CAN_RX0_IRQ) )
+		return false;
+	host_interrupt(usb_lp_can_rx0_isr);
+	return true;
+}
+
+bool
+hostusb_wait_attach(uint32_t timeout_ms) {
+	uint64_t deadline = host_now_us() + (uint64_t)timeout_ms * 1000;
+
+	while ( !attached || !nvic_get_irq_enabled(NVIC_USB_LP_CAN_RX0_IRQ) ) {
+		if ( host_now_us() >= deadline )
+			return false;
+		host_sleep_until_us(host_now_us() + 100);
+	}
+	return true;
+}
+
+void
+hostusb_reset(void) {
+	event.reset = true;
+	if ( !hostusb_interrupt() )
+		event.reset = false;
+}
+
+int
+hostusb_control(const struct usb_setup_data *setup, uint8_t *data) {
+	if ( !(setup->bmRequestType & USB_REQ_TYPE_IN) && setup->wLength > device.control_buffer_size )
+		return -1;
+	event.req = *setup;
+	event.data = data;
+	event.result = -1;
+	event.setup = true;
+	if ( !hostusb_interrupt() ) {
+		event.setup = false;
+		return -1;
+	}
+	return event.result;
+}
+
+int
+hostusb_in(uint8_t ep, uint8_t *data) {
+	int len = -1;
+
+	if ( ep != 0x81 )
+		return -1;
+	pthread_mutex_lock(&sie);
+	if ( device.in.configured && device.in.valid ) {
+		memcpy(data, device.in.data, device.in.len);
+		len = device.in.len;
+		device.in.valid = false;	/* ACK: the transfer is complete */
+	}
+	pthread_mutex_unlock(&sie);
+
+	if ( len >= 0 ) {
+		event.in_complete = true;
+		hostusb_interrupt();
+	}
+	return len;
+}
+
+int
+hostusb_enumerate(uint8_t idle_rate) {
+	struct usb_setup_data setup;
+	uint8_t data[256];
+	int len;
+
+	hostusb_reset();
+
+	setup = (struct usb_setup_data){ 0x80, USB_REQ_GET_DESCRIPTOR, USB_DT_DEVICE << 8, 0, 64 };
+	if ( hostusb_control(&setup, data) != USB_DT_DEVICE_SIZE )
+		return -1;
+	setup = (struct usb_setup_data){ 0x00, USB_REQ_SET_ADDRESS, 1, 0, 0 };
+	if ( hostusb_control(&setup, NULL) != 0 )
+		return -1;
+	setup = (struct usb_setup_data){ 0x80, USB_REQ_GET_DESCRIPTOR, USB_DT_CONFIGURATION << 8, 0, USB_DT_CONFIGURATION_SIZE };
+	if ( hostusb_control(&setup, data) != USB_DT_CONFIGURATION_SIZE )
+		return -1;
+	setup.wLength = data[2] | data[3] << 8;		/* wTotalLength */
+	if ( hostusb_control(&setup, data) != setup.wLength )
+		return -1;
+	setup = (struct usb_setup_data){ 0x00, USB_REQ_SET_CONFIGURATION, data[5], 0, 0 };
+	if ( hostusb_control(&setup, NULL) != 0 )
+		return -1;
+
+	setup = (struct usb_setup_data){ 0x81, USB_REQ_GET_DESCRIPTOR, 0x2200, 0, sizeof(data) };
+	len = hostusb_control(&setup, data);
+	if ( len <= 0 )
+		return -1;
+	setup = (struct usb_setup_data){ 0x21, 0x0A, idle_rate << 8, 0, 0 };	/* SET_IDLE */
+	if ( hostusb_control(&setup, NULL) != 0 )
+		return -1;
+	return len;
+}
+
+/*
+ * Firmware bring-up, the hooks main() gives usbhid
+ */
+static struct Joystick_ *joystick;
+
+static void
+read_joystick_report(uint8_t report[PACKET_SIZE]) {
+	Joystick_getReport(joystick, (struct Joystick_report *)report);
+}
+
+static void
+retry_joystick_report(BaseType_t *higherPriorityTaskWoken) {
+	Joystick_retryFromISR(joystick, higherPriorityTaskWoken);
+}
+
+int
+hostusb_start_joystick(struct Joystick_ *js, QueueHandle_t *txq, uint8_t idle_rate) {
+	int len;
+
+	joystick = js;
+	*txq = xQueueCreate(USBHID_TXQ_LENGTH,sizeof(struct usbhid_frame));
+	Joystick_start(js, txq);
+	usbhid_set_report_source(read_joystick_report);
+	usbhid_set_queue_space(retry_joystick_report);
+	usbhid_start(txq);
+
+	if ( !hostusb_wait_attach(1000) ) {
+		fprintf(stderr, "device did not attach\n");
+		return -1;
+	}
+	len = hostusb_enumerate(idle_rate);
+	if ( len < 0 ) {
+		fprintf(stderr, "enumeration failed\n");
+		return -1;
+	}
+	while ( !usbhid_ready() )
+		vTaskDelay(1);
+	return len;
+}
+
+// End hostusb.c
@@ -0,0 +1,61 @@
+/* Host build
+ * The bus side of the simulated USB device (hostusb.c): what a host
+ * controller does to the firmware. The device side is the libopencm3
+ * usbd API, with host_usb_driver as the driver.
+ *
+ * Every transfer the device takes part in raises the USB interrupt, which
+ * runs usb_lp_can_rx0_isr() under the interrupt mask (host_interrupt), so
+ * the firmware sees the same callbacks in the same context as on the
+ * target. Call these from one host thread.
+ */
+#ifndef HOSTUSB_H
+#define HOSTUSB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+struct Joystick_;
+
+/* Waits until the firmware has pulled D+ up (usbd_init and the USB interrupt enabled) */
+bool hostusb_wait_attach(uint32_t timeout_ms);
+
+/* Bus reset: the device is unconfigured, the endpoints are emptied */
+void hostusb_reset(void);
+
+/*
+ * Control transfer on endpoint 0. data holds wLength bytes: the data stage
+ * of an OUT request, or room for the answer of an IN request.
+ * Returns the bytes of the data stage, or -1 when the device stalls.
+ */
+int hostusb_control(const struct usb_setup_data *setup, uint8_t *data);
+
+/*
+ * IN token on endpoint ep, as the host controller sends one every
+ * bInterval. Returns the packet length, or -1 when the endpoint NAKs.
+ */
+int hostusb_in(uint8_t ep, uint8_t *data);
+
+/*
+ * Enumerates the device the way a host does: bus reset, device and config
+ * descriptors, SET_CONFIGURATION 1, the HID report descriptor and
+ * SET_IDLE with idle_rate (4 ms units). Returns the report descriptor
+ * length, or -1 when a step fails.
+ */
+int hostusb_enumerate(uint8_t idle_rate);
+
+/*
+ * Brings the joystick up as main() does: creates its report queue in
+ * *txq, starts it and usbhid_start() with the report source and the
+ * queue space hook on it. Then attaches, enumerates with idle_rate and
+ * waits until usbhid_ready(). One joystick per program.
+ * Returns the report descriptor length, or -1 after printing the step
+ * that failed.
+ */
+int hostusb_start_joystick(struct Joystick_ *js, QueueHandle_t *txq, uint8_t idle_rate);
+
+#endif /* HOSTUSB_H */
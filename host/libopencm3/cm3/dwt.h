@@ -0,0 +1,19 @@
+/* Host build: libopencm3 DWT, a 72 MHz cycle counter on the host clock (hosthal.c) */
+#ifndef LIBOPENCM3_DWT_H
+#define LIBOPENCM3_DWT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern uint32_t host_dwt_ctrl;
+
+#define DWT_CTRL			host_dwt_ctrl
+#define DWT_CTRL_CYCCNTENA		(1 << 0)
+
+bool dwt_enable_cycle_counter(void);
+uint32_t dwt_read_cycle_counter(void);
+
+/* Host only: how many times dwt_enable_cycle_counter() zeroed the counter */
+uint32_t dwt_get_resets(void);
+
+#endif
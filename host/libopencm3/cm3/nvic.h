@@ -0,0 +1,18 @@
+/* Host build: libopencm3 NVIC, the interrupts the firmware enables (hosthal.c) */
+#ifndef LIBOPENCM3_NVIC_H
+#define LIBOPENCM3_NVIC_H
+
+#include <stdint.h>
+
+#define NVIC_DMA1_CHANNEL1_IRQ		11
+#define NVIC_USB_LP_CAN_RX0_IRQ		20
+#define NVIC_IRQ_COUNT			68
+
+void nvic_enable_irq(uint8_t irqn);
+void nvic_disable_irq(uint8_t irqn);
+void nvic_set_priority(uint8_t irqn, uint8_t priority);
+
+/* Host only: true once the firmware enabled the interrupt */
+uint8_t nvic_get_irq_enabled(uint8_t irqn);
+
+#endif
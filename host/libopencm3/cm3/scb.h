@@ -0,0 +1,12 @@
+/* Host build: libopencm3 SCB, the active exception as host_interrupt() sets it (hostrtos.c) */
+#ifndef LIBOPENCM3_SCB_H
+#define LIBOPENCM3_SCB_H
+
+#include <stdint.h>
+
+extern __thread uint32_t host_scb_icsr;
+
+#define SCB_ICSR			host_scb_icsr
+#define SCB_ICSR_VECTACTIVE		0x1FF
+
+#endif
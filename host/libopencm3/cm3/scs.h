@@ -0,0 +1,12 @@
+/* Host build: libopencm3 SCS, the debug enable the cycle counter needs (hosthal.c) */
+#ifndef LIBOPENCM3_SCS_H
+#define LIBOPENCM3_SCS_H
+
+#include <stdint.h>
+
+extern uint32_t host_scs_demcr;
+
+#define SCS_DEMCR			host_scs_demcr
+#define SCS_DEMCR_TRCENA		(1 << 24)
+
+#endif
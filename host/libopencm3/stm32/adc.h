@@ -0,0 +1,30 @@
+/* Host build: libopencm3 ADC, setup is a no-op (hosthal.c) */
+#ifndef LIBOPENCM3_ADC_H
+#define LIBOPENCM3_ADC_H
+
+#include <stdint.h>
+
+#define ADC1				0
+
+extern volatile uint32_t host_adc_dr[1];
+#define ADC_DR(adc)			(host_adc_dr[adc])
+
+#define ADC_CR1_DUALMOD_IND		0
+#define ADC_CR2_EXTSEL_TIM3_TRGO	(0x4 << 17)
+#define ADC_SMPR_SMP_28DOT5CYC		0x3
+#define ADC_SMPR_SMP_55DOT5CYC		0x5
+
+void adc_power_on(uint32_t adc);
+void adc_power_off(uint32_t adc);
+void adc_set_dual_mode(uint32_t mode);
+void adc_enable_scan_mode(uint32_t adc);
+void adc_set_single_conversion_mode(uint32_t adc);
+void adc_set_right_aligned(uint32_t adc);
+void adc_set_sample_time_on_all_channels(uint32_t adc, uint8_t time);
+void adc_set_regular_sequence(uint32_t adc, uint8_t length, uint8_t channel[]);
+void adc_enable_external_trigger_regular(uint32_t adc, uint32_t trigger);
+void adc_enable_dma(uint32_t adc);
+void adc_reset_calibration(uint32_t adc);
+void adc_calibrate(uint32_t adc);
+
+#endif
@@ -0,0 +1,38 @@
+/* Host build: libopencm3 DMA, setup is a no-op (hosthal.c) */
+#ifndef LIBOPENCM3_DMA_H
+#define LIBOPENCM3_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DMA1				0
+#define DMA_CHANNEL1			1
+
+#define DMA_GIF				(1 << 0)
+#define DMA_TCIF			(1 << 1)
+#define DMA_HTIF			(1 << 2)
+
+#define DMA_CCR_PL_HIGH			(0x2 << 12)
+#define DMA_CCR_MSIZE_16BIT		(0x1 << 10)
+#define DMA_CCR_PSIZE_16BIT		(0x1 << 8)
+
+void dma_channel_reset(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel, uint32_t peripheral_size);
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size);
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel);
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio);
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_channel(uint32_t dma, uint8_t channel);
+/* Host only: the flags dma_get_interrupt_flag() reports, set by a test */
+extern volatile uint32_t host_dma_flags;
+
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts);
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts);
+
+#endif
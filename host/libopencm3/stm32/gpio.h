@@ -0,0 +1,25 @@
+/* Host build: libopencm3 GPIO, pin writes are a no-op (hosthal.c) */
+#ifndef LIBOPENCM3_GPIO_H
+#define LIBOPENCM3_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA			0
+#define GPIOB			1
+#define GPIOC			2
+
+#define GPIO0			(1 << 0)
+#define GPIO1			(1 << 1)
+#define GPIO12			(1 << 12)
+#define GPIO13			(1 << 13)
+
+#define GPIO_MODE_INPUT		0
+#define GPIO_MODE_OUTPUT_2_MHZ	2
+#define GPIO_CNF_INPUT_ANALOG	0
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios);
+void gpio_set(uint32_t gpioport, uint16_t gpios);
+void gpio_clear(uint32_t gpioport, uint16_t gpios);
+
+#endif
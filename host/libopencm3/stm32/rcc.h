@@ -0,0 +1,26 @@
+/* Host build: libopencm3 RCC, clock setup is a no-op (hosthal.c) */
+#ifndef LIBOPENCM3_RCC_H
+#define LIBOPENCM3_RCC_H
+
+#include <stdint.h>
+
+enum rcc_periph_clken {
+	RCC_GPIOA, RCC_GPIOB, RCC_GPIOC, RCC_USB, RCC_ADC1, RCC_DMA1, RCC_TIM3,
+};
+
+enum rcc_periph_rst {
+	RST_TIM3,
+};
+
+#define RCC_CFGR_ADCPRE_PCLK2_DIV6	2
+
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+extern uint32_t rcc_apb2_frequency;
+
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void);
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_periph_reset_pulse(enum rcc_periph_rst rst);
+void rcc_set_adcpre(uint32_t adcpre);
+
+#endif
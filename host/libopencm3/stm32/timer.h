@@ -0,0 +1,20 @@
+/* Host build: libopencm3 timers, setup is a no-op (hosthal.c) */
+#ifndef LIBOPENCM3_TIMER_H
+#define LIBOPENCM3_TIMER_H
+
+#include <stdint.h>
+
+#define TIM3				2
+
+#define TIM_CR1_CKD_CK_INT		0
+#define TIM_CR1_CMS_EDGE		0
+#define TIM_CR1_DIR_UP			0
+#define TIM_CR2_MMS_UPDATE		(0x2 << 4)
+
+void timer_set_mode(uint32_t timer_peripheral, uint32_t clock_div, uint32_t alignment, uint32_t direction);
+void timer_set_prescaler(uint32_t timer_peripheral, uint32_t value);
+void timer_set_period(uint32_t timer_peripheral, uint32_t period);
+void timer_set_master_mode(uint32_t timer_peripheral, uint32_t mode);
+void timer_enable_counter(uint32_t timer_peripheral);
+
+#endif
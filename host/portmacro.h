@@ -0,0 +1,57 @@
+/* Host build
+ * FreeRTOS port definitions for hostrtos.c: tasks are threads, and the
+ * interrupt mask (BASEPRI) is one recursive lock that simulated
+ * interrupts hold while they run. See hostrtos.h.
+ */
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#include <stdint.h>
+
+#define portCHAR		char
+#define portFLOAT		float
+#define portDOUBLE		double
+#define portLONG		long
+#define portSHORT		short
+#define portSTACK_TYPE	uint32_t
+#define portBASE_TYPE	long
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef uint32_t TickType_t;
+#define portMAX_DELAY ( TickType_t ) 0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC 1
+
+#define portSTACK_GROWTH			( -1 )
+#define portTICK_PERIOD_MS			( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT			8
+
+/* Scheduler utilities: the host scheduler preempts on its own */
+extern void vPortYield( void );
+#define portYIELD()						vPortYield()
+#define portEND_SWITCHING_ISR( x )		( void ) ( x )
+#define portYIELD_FROM_ISR( x )			portEND_SWITCHING_ISR( x )
+
+/* Critical section management */
+extern UBaseType_t ulPortRaiseMask( void );
+extern void vPortSetMask( UBaseType_t );
+#define portSET_INTERRUPT_MASK_FROM_ISR()		ulPortRaiseMask()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)	vPortSetMask(x)
+#define portDISABLE_INTERRUPTS()				( void ) ulPortRaiseMask()
+#define portENABLE_INTERRUPTS()					vPortSetMask(0)
+#define portENTER_CRITICAL()					( void ) ulPortRaiseMask()
+#define portEXIT_CRITICAL()						vPortSetMask(0)
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters ) void vFunction( void *pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters ) void vFunction( void *pvParameters )
+
+#define portNOP()
+#define portINLINE	__inline
+#define portFORCE_INLINE inline __attribute__(( always_inline))
+
+/* Tasks run in parallel here, so the seqlock readers need real fences */
+#define portMEMORY_BARRIER() __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
+#endif /* PORTMACRO_H */
@@ -0,0 +1,68 @@
+/* Host build
+ * ADC capture replay, see replay.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "replay.h"
+
+uint16_t (*replay_blocks)[ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT];
+unsigned replay_block_count;
+
+void
+replay_alloc(unsigned count) {
+	free(replay_blocks);
+	replay_block_count = count;
+	replay_blocks = calloc(count ? count : 1, sizeof(*replay_blocks));
+}
+
+bool
+replay_load(const char *path) {
+	FILE *f = fopen(path, "rb");
+	uint8_t sample[2];
+	unsigned b, scan, ch;
+
+	if ( f == NULL )
+		return false;
+	fseek(f, 0, SEEK_END);
+	replay_alloc(ftell(f) / sizeof(replay_blocks[0]));
+	rewind(f);
+	for ( b = 0; b < replay_block_count; b++ )
+		for ( scan = 0; scan < ADCSCAN_OVERSAMPLE; scan++ )
+			for ( ch = 0; ch < ADCSCAN_CHANNEL_COUNT; ch++ ) {
+				if ( fread(sample, 1, 2, f) != 2 ) {
+					fclose(f);
+					return false;
+				}
+				replay_blocks[b][scan][ch] = sample[0] | sample[1] << 8;
+			}
+	fclose(f);
+	return replay_block_count != 0;
+}
+
+/* What the simulated interrupt replays */
+static struct Joystick_ *replay_joystick;
+static const uint16_t (*replay_scans)[ADCSCAN_CHANNEL_COUNT];
+
+static void
+replay_isr(void) {
+	BaseType_t woken = pdFALSE;
+
+	adcscan_process(replay_joystick, replay_scans, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+void
+replay_block(struct Joystick_ *js, unsigned b) {
+	replay_joystick = js;
+	replay_scans = (const uint16_t (*)[ADCSCAN_CHANNEL_COUNT])replay_blocks[b];
+	host_interrupt(replay_isr);
+}
+
+// End replay.c
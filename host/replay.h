@@ -0,0 +1,31 @@
+/* Host build
+ * ADC captures for the adcscan tests (replay.c): loaded from a file or
+ * synthesized by the test, then replayed block by block through
+ * adcscan_process(), the code the DMA interrupt runs.
+ *
+ * A capture file holds raw little-endian 16 bit samples,
+ * ADCSCAN_CHANNEL_COUNT per scan in ADCSCAN_CHANNELS order, as DMA
+ * stores them. Built with the program's ADCSCAN_* options.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../adcscan.h"
+
+/* The capture, replay_block_count blocks of ADCSCAN_OVERSAMPLE scans */
+extern uint16_t (*replay_blocks)[ADCSCAN_OVERSAMPLE][ADCSCAN_CHANNEL_COUNT];
+extern unsigned replay_block_count;
+
+/* Room for a synthetic capture of count blocks, zeroed */
+void replay_alloc(unsigned count);
+
+/* Reads a capture file. Returns false if it can not, or if it holds no whole block */
+bool replay_load(const char *path);
+
+/* Runs adcscan_process() on block b from a simulated DMA interrupt */
+void replay_block(struct Joystick_ *js, unsigned b);
+
+#endif /* REPLAY_H */
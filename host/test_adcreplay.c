@@ -0,0 +1,131 @@
+/* Host build
+ * Replays ADC scans through adcscan_process(), the code the DMA
+ * interrupt runs, and checks every update end to end: the joystick state
+ * and the report the host reads must hold the decimated, scaled samples.
+ *
+ *	test_adcreplay [capture]
+ *
+ * capture: a raw DMA capture, see replay.h. Without one a synthetic
+ * capture is used: ramps, a sine, a step and noise.
+ * Also checks that a late DMA interrupt (both flags) counts an overrun.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include <libopencm3/stm32/dma.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+#include "../adcscan.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+#include "replay.h"
+
+#define SYNTHETIC_BLOCKS	2000
+
+extern void dma1_channel1_isr(void);
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static void
+synthesize(void) {
+	uint32_t noise = 1;
+	unsigned b, scan, n;
+	double x;
+
+	replay_alloc(SYNTHETIC_BLOCKS);
+	for ( b = 0; b < replay_block_count; b++ ) {
+		for ( scan = 0; scan < ADCSCAN_OVERSAMPLE; scan++ ) {
+			n = b * ADCSCAN_OVERSAMPLE + scan;
+			x = (double)n / (SYNTHETIC_BLOCKS * ADCSCAN_OVERSAMPLE);
+			noise = noise * 1103515245 + 12345;
+			replay_blocks[b][scan][0] = 4095 * x;					/* X: ramp up */
+			replay_blocks[b][scan][1] = 2048 + 2000 * sin(6.283185307 * 3 * x);	/* Y: sine */
+			replay_blocks[b][scan][2] = 2048 + (int)((noise >> 16) % 7) - 3;	/* Z: noisy center */
+			replay_blocks[b][scan][3] = x < 0.5 ? 0 : 4095;			/* accelerator: step */
+			replay_blocks[b][scan][4] = 4095 - 4095 * x;				/* brake: ramp down */
+			replay_blocks[b][scan][5] = (noise >> 8) & 0xFFF;			/* steering: noise */
+		}
+	}
+}
+
+/*
+ * What the report must hold: the rounded mean at ADCSCAN_BITS, mapped
+ * from 0..ADCSCAN_MAXIMUM to the report range
+ */
+static int16_t
+expected_axis(unsigned b, unsigned axis) {
+	int64_t sum = 0, value;
+	unsigned scan;
+
+	for ( scan = 0; scan < ADCSCAN_OVERSAMPLE; scan++ )
+		sum += replay_blocks[b][scan][axis];
+	value = (sum * (1 << (ADCSCAN_BITS - 12)) + ADCSCAN_OVERSAMPLE / 2) / ADCSCAN_OVERSAMPLE;
+	if ( value > ADCSCAN_MAXIMUM )
+		value = ADCSCAN_MAXIMUM;
+	return (int16_t)(value * (JOYSTICK_AXIS_MAXIMUM - JOYSTICK_AXIS_MINIMUM + 1) / (ADCSCAN_MAXIMUM + 1) + JOYSTICK_AXIS_MINIMUM);
+}
+
+int
+main(int argc, char **argv) {
+	struct Joystick_report report, previous;
+	struct adcscan_stats stats;
+	uint8_t packet[64];
+	unsigned b, axis, spins, errors = 0, reads = 0;
+	int16_t expected;
+
+	if ( argc > 1 ? !replay_load(argv[1]) : (synthesize(), false) ) {
+		fprintf(stderr, "can not read %s\n", argv[1]);
+		return 2;
+	}
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	adcscan_start(&joystick);
+
+	Joystick_getReport(&joystick, &previous);
+	for ( b = 0; b < replay_block_count; b++ ) {
+		replay_block(&joystick, b);
+
+		Joystick_getReport(&joystick, &report);
+		for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ ) {
+			expected = expected_axis(b, axis);
+			if ( report.axis[axis] != expected && errors++ < 10 )
+				printf("block %u axis %u: %d, not %d\n", b, axis, report.axis[axis], expected);
+		}
+		if ( memcmp(&report, &previous, sizeof(report)) == 0 )
+			continue;		/* suppressed, nothing to read */
+		previous = report;
+
+		for ( spins = 0; hostusb_in(0x81, packet) < 0; spins++ ) {
+			if ( spins > 1000000 ) {
+				printf("block %u never reached the host\n", b);
+				return 1;
+			}
+			sched_yield();
+		}
+		++reads;
+		if ( memcmp(packet, &report, PACKET_SIZE) != 0 && errors++ < 10 )
+			printf("block %u: the host read another report\n", b);
+	}
+
+	adcscan_get_stats(&stats);
+	host_dma_flags = DMA_HTIF | DMA_TCIF;		/* both halves done: too late */
+	host_interrupt(dma1_channel1_isr);
+	adcscan_get_stats(&stats);
+
+	printf("%u blocks of %u scans, %u bit axes, %u reports read, %u errors, overruns %u\n",
+		replay_block_count, ADCSCAN_OVERSAMPLE, ADCSCAN_BITS, reads, errors, stats.overruns);
+	return errors != 0 || stats.overruns != 2 || host_dma_flags != 0;
+}
+
+// End test_adcreplay.c
@@ -0,0 +1,131 @@
+/* Host build
+ * axisfilter against double precision references:
+ * - the Q15 IIR against the same recurrence computed in double (every
+ *   value is an integer below 2^53, so the two must agree bit for bit),
+ *   and against the ideal filter without rounding, within 1.5 LSB
+ * - the 3 and 5 tap median against a sort of the last samples
+ * - median and IIR in series, and the settings that turn them off
+ * Inputs: random full scale int16 swings, small noise and steps.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../axisfilter.h"
+
+#define SAMPLES		100000
+
+static const uint16_t alphas[] = {
+	1, 7, 100, AXISFILTER_ALPHA(10, 1000), 8192, 16384, 32767, AXISFILTER_ALPHA_OFF,
+};
+
+static uint32_t noise = 1;
+static unsigned errors;
+
+/* Test signal k, sample n */
+static int16_t
+input(unsigned k, unsigned n) {
+	noise = noise * 1103515245 + 12345;
+	switch ( k ) {
+	case 0:  return (int16_t)(noise >> 16);				/* full scale noise */
+	case 1:  return (n / 500) & 1 ? INT16_MAX : INT16_MIN;		/* full scale steps */
+	case 2:  return 2048 + (int)((noise >> 16) % 9) - 4;		/* ADC noise */
+	default: return (int16_t)(10000 * sin(n / 300.0)) + (int)((noise >> 16) % 2001) - 1000;
+	}
+}
+
+static void
+fail(const char *what, unsigned alpha, unsigned taps, unsigned k, unsigned n, double got, double want) {
+	if ( errors++ < 10 )
+		printf("%s, alpha %u taps %u signal %u sample %u: %.3f, not %.3f\n", what, alpha, taps, k, n, got, want);
+}
+
+/* Median of the last taps samples, the history primed with the first */
+static int16_t
+median_reference(int16_t *window, unsigned taps, unsigned n, int16_t value) {
+	int16_t sorted[AXISFILTER_MEDIAN_MAX], v;
+	unsigned i, j;
+
+	if ( n == 0 )
+		for ( i = 0; i < taps; i++ )
+			window[i] = value;
+	window[n % taps] = value;
+	for ( i = 0; i < taps; i++ ) {
+		v = window[i];
+		for ( j = i; j > 0 && sorted[j - 1] > v; j-- )
+			sorted[j] = sorted[j - 1];
+		sorted[j] = v;
+	}
+	return sorted[taps / 2];
+}
+
+static void
+check(uint16_t alpha, uint8_t taps, unsigned k) {
+	struct axisfilter f;
+	int16_t window[AXISFILTER_MEDIAN_MAX], x, got;
+	double state = 0, ideal = 0, want;
+	bool iir = alpha != AXISFILTER_ALPHA_OFF;
+	unsigned n;
+
+	axisfilter_init(&f, taps, alpha);
+	for ( n = 0; n < SAMPLES; n++ ) {
+		x = input(k, n);
+		got = axisfilter_apply(&f, x);
+
+		if ( taps )
+			x = median_reference(window, taps, n, x);
+		if ( n == 0 ) {
+			state = x * 32768.0;
+			ideal = x;
+		}
+		if ( !iir ) {
+			if ( got != x )
+				fail("pass through", alpha, taps, k, n, got, x);
+			continue;
+		}
+		state += floor(alpha * (x * 32768.0 - state) / 32768);
+		want = floor((state + 16384) / 32768);
+		if ( got != want )
+			fail("Q15 recurrence", alpha, taps, k, n, got, want);
+		ideal += alpha / 32768.0 * (x - ideal);
+		if ( fabs(got - ideal) > 1.5 )
+			fail("ideal filter", alpha, taps, k, n, got, ideal);
+	}
+}
+
+int
+main(void) {
+	static const uint8_t taps[] = { 0, 3, 5 };
+	struct axisfilter f;
+	struct timespec t0, t1;
+	unsigned a, t, k, n, checks = 0;
+	int16_t sink = 0;
+
+	for ( a = 0; a < sizeof(alphas) / sizeof(alphas[0]); a++ )
+		for ( t = 0; t < sizeof(taps); t++ )
+			for ( k = 0; k < 4; k++, checks++ )
+				check(alphas[a], taps[t], k);
+
+	/* settings that turn a stage off */
+	axisfilter_init(&f, 4, 0);
+	for ( n = 0; n < 1000; n++ ) {
+		int16_t x = input(0, n);
+
+		if ( axisfilter_apply(&f, x) != x )
+			fail("4 taps, alpha 0", 0, 4, 0, n, axisfilter_apply(&f, x), x);
+	}
+
+	/* host time per sample, 5 tap median and IIR */
+	axisfilter_init(&f, 5, AXISFILTER_ALPHA(10, 1000));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for ( n = 0; n < 10 * SAMPLES; n++ )
+		sink ^= axisfilter_apply(&f, (int16_t)(n * 7919));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%u runs of %u samples, %u errors; median 5 + IIR %.1f host ns per sample%s\n", checks, SAMPLES, errors,
+		((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / (10 * SAMPLES), sink == 12345 ? " " : "");
+	return errors != 0;
+}
+
+// End test_axisfilter.c
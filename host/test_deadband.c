@@ -0,0 +1,149 @@
+/* Host build
+ * Report rate of a noisy stick capture with and without the deadband:
+ * the capture is replayed through adcscan_process(), one block per
+ * millisecond of capture, and the reports published to usb_task are
+ * counted for each setting of the hysteresis and the center deadzone.
+ *
+ *	test_deadband [capture]
+ *
+ * capture: a raw DMA capture, see replay.h. The synthetic one has every
+ * axis rest off center for 1 s, move to the top end stop and sit there
+ * for 1 s, then to the bottom one for 1 s, with +-2 LSB of noise
+ * throughout.
+ * Checks that the hysteresis cuts the reports at rest at least 5 times,
+ * that with it the stick still reports the end points exactly when it sits on
+ * them and that with the deadzone the rest position reports the center
+ * exactly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+#include "../adcscan.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+#include "replay.h"
+
+#define PHASE		(ADCSCAN_RATE_HZ)		/* blocks in a one second phase */
+#define REST		(ADCSCAN_CENTER + 10)
+#define NOISE		2
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static const struct {
+	const char *name;
+	uint16_t hysteresis;
+	uint16_t deadzone;
+} settings[] = {
+	{ "none", 0, 0 },
+	{ "hysteresis 4", 4, 0 },
+	{ "hysteresis 4, deadzone 24", 4, 24 },
+};
+
+/* rest, move up, top end stop, move down, bottom end stop; the noise touches the stops */
+static int
+stick(unsigned b) {
+	unsigned phase = b / PHASE, at = b % PHASE;
+
+	switch ( phase ) {
+	case 0:  return REST;
+	case 1:  return REST + (int)((4095 - NOISE - REST) * at / PHASE);
+	case 2:  return 4095 - NOISE;
+	case 3:  return 4095 - NOISE - (int)((4095 - 2 * NOISE) * at / PHASE);
+	default: return NOISE;
+	}
+}
+
+static void
+synthesize(void) {
+	uint32_t noise = 1;
+	unsigned b, scan, ch;
+	int v;
+
+	replay_alloc(5 * PHASE);
+	for ( b = 0; b < replay_block_count; b++ )
+		for ( scan = 0; scan < ADCSCAN_OVERSAMPLE; scan++ )
+			for ( ch = 0; ch < ADCSCAN_CHANNEL_COUNT; ch++ ) {
+				noise = noise * 1103515245 + 12345;
+				v = stick(b) + (int)((noise >> 16) % (2 * NOISE + 1)) - NOISE;
+				replay_blocks[b][scan][ch] = v < 0 ? 0 : v > 4095 ? 4095 : v;	/* the ADC clips */
+			}
+}
+
+static int16_t
+scaled(int32_t value) {
+	return (int16_t)((int64_t)value * (JOYSTICK_AXIS_MAXIMUM - JOYSTICK_AXIS_MINIMUM + 1) / (ADCSCAN_MAXIMUM + 1) + JOYSTICK_AXIS_MINIMUM);
+}
+
+int
+main(int argc, char **argv) {
+	struct Joystick_report report;
+	struct adcscan_stats stats;
+	uint32_t sent, rest_sent, rest_none = 0, held;
+	unsigned s, b, axis;
+	bool top, bottom, center, ok = true;
+	uint8_t packet[64];
+
+	if ( argc > 1 ? !replay_load(argv[1]) : (synthesize(), false) ) {
+		fprintf(stderr, "can not read %s\n", argv[1]);
+		return 2;
+	}
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+
+	printf("%u blocks at %u Hz, %s\n", replay_block_count, ADCSCAN_RATE_HZ, argc > 1 ? argv[1] : "synthetic capture");
+	for ( s = 0; s < sizeof(settings) / sizeof(settings[0]); s++ ) {
+		adcscan_start(&joystick);
+		for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+			adcscan_set_deadband(axis, settings[s].hysteresis, ADCSCAN_CENTER, settings[s].deadzone);
+		adcscan_get_stats(&stats);
+		held = stats.held;
+		sent = Joystick_getReportsSent(&joystick);
+		rest_sent = 0;
+		top = bottom = center = false;
+
+		for ( b = 0; b < replay_block_count; b++ ) {
+			replay_block(&joystick, b);
+			Joystick_getReport(&joystick, &report);
+			if ( b == PHASE - 1 ) {
+				rest_sent = Joystick_getReportsSent(&joystick) - sent;
+				center = report.axis[0] == scaled(ADCSCAN_CENTER);
+			} else if ( b == 3 * PHASE - 1 ) {
+				top = report.axis[0] == scaled(ADCSCAN_MAXIMUM);
+			} else if ( b == 5 * PHASE - 1 ) {
+				bottom = report.axis[0] == scaled(0);
+			}
+			hostusb_in(0x81, packet);	/* keep the endpoint moving */
+		}
+		sent = Joystick_getReportsSent(&joystick) - sent;
+		adcscan_get_stats(&stats);
+
+		printf("%-26s %5u reports (%4u at rest), %6u axis changes held, end stops %s, center %s\n",
+			settings[s].name, sent, rest_sent, stats.held - held,
+			top && bottom ? "reached" : "dithering", center ? "exact" : "off");
+
+		if ( argc > 1 )
+			continue;		/* no expectations for a recorded capture */
+		if ( s == 0 )
+			rest_none = rest_sent;
+		else
+			ok = ok && rest_sent * 5 <= rest_none;
+		/* without hysteresis the report dithers with the noise on the stops */
+		ok = ok && (top && bottom) == (settings[s].hysteresis != 0) && center == (settings[s].deadzone != 0);
+	}
+
+	if ( !ok )
+		printf("FAIL\n");
+	return !ok;
+}
+
+// End test_deadband.c
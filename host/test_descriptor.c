@@ -0,0 +1,266 @@
+/* Host build
+ * The HID report descriptor against hidlayout.h and the report struct:
+ * the descriptor is read from the device as a host reads it and parsed
+ * into fields, each with its usage, bit offset and size. Then:
+ *
+ * - every button, hat and axis is described once, at the bit offset
+ *   HID_REPORT_*_OFFSET gives, with the right size and limits, and the
+ *   fields cover the HID_REPORT_SIZE bytes exactly;
+ * - a report read from the endpoint, decoded with the parsed offsets,
+ *   holds the values struct Joystick_report holds.
+ *
+ * Built for several layouts: test_descriptor (the default),
+ * test_descriptor_hats (13 buttons, 3 hats: both paddings) and
+ * test_descriptor_128 (128 buttons, 4 hats).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define FIELDS_MAX	(HID_BUTTON_COUNT + 8 + HID_HAT_COUNT + JOYSTICK_AXIS_COUNT)
+#define USAGES_MAX	16
+
+/* One Input field: constant fields are padding */
+struct field {
+	uint16_t page, usage;
+	unsigned bit, size;
+	int32_t minimum, maximum;
+	bool constant;
+};
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static struct field fields[FIELDS_MAX];
+static unsigned field_count;
+static unsigned report_bits;		/* report id included */
+static int report_id = -1;
+
+static int32_t
+item_value(const uint8_t *data, unsigned size, bool sign) {
+	uint32_t value = 0;
+	unsigned i;
+
+	for ( i = 0; i < size; i++ )
+		value |= (uint32_t)data[i] << (8 * i);
+	if ( sign && size > 0 && size < 4 && (value & (1u << (8 * size - 1))) )
+		value |= ~0u << (8 * size);
+	return (int32_t)value;
+}
+
+/*
+ * Parses the short items of a report descriptor with a single report.
+ * Returns false on an item this parser does not know.
+ */
+static bool
+parse(const uint8_t *d, int len) {
+	uint16_t page = 0, usages[USAGES_MAX];
+	unsigned usage_count = 0, usage_minimum = 0, usage_maximum = 0, size = 0, count = 0, i;
+	int32_t minimum = 0, maximum = 0;
+	bool range = false;
+	int pos = 0;
+
+	report_bits = 8;
+	while ( pos < len ) {
+		uint8_t prefix = d[pos];
+		unsigned n = (prefix & 3) == 3 ? 4 : prefix & 3;
+		const uint8_t *data = &d[pos + 1];
+
+		if ( prefix == 0xFE || pos + 1 + (int)n > len )
+			return false;		/* long item, or cut short */
+		pos += 1 + n;
+
+		switch ( prefix & 0xFC ) {
+		/* Main */
+		case 0x80:			/* INPUT */
+			for ( i = 0; i < count; i++ ) {
+				struct field *f;
+
+				if ( field_count == FIELDS_MAX )
+					return false;
+				f = &fields[field_count++];
+				f->bit = report_bits;
+				f->size = size;
+				f->minimum = minimum;
+				f->maximum = maximum;
+				f->constant = item_value(data, n, false) & 1;
+				f->page = page;
+				if ( range )
+					f->usage = usage_minimum + i <= usage_maximum ? usage_minimum + i : usage_maximum;
+				else if ( usage_count > 0 )
+					f->usage = usages[i < usage_count ? i : usage_count - 1];
+				else
+					f->usage = 0;
+				report_bits += size;
+			}
+			/* a main item ends the local items */
+			/* fall through */
+		case 0xA0:			/* COLLECTION */
+		case 0xC0:			/* END_COLLECTION */
+			usage_count = 0;
+			range = false;
+			break;
+
+		/* Global */
+		case 0x04: page = item_value(data, n, false); break;
+		case 0x14: minimum = item_value(data, n, true); break;
+		case 0x24: maximum = item_value(data, n, true); break;
+		case 0x34:			/* PHYSICAL_MINIMUM */
+		case 0x44:			/* PHYSICAL_MAXIMUM */
+		case 0x54:			/* UNIT_EXPONENT */
+		case 0x64:			/* UNIT */
+			break;
+		case 0x74: size = item_value(data, n, false); break;
+		case 0x84:
+			if ( report_id >= 0 )
+				return false;	/* a second report */
+			report_id = item_value(data, n, false);
+			break;
+		case 0x94: count = item_value(data, n, false); break;
+
+		/* Local */
+		case 0x08:
+			if ( usage_count == USAGES_MAX )
+				return false;
+			usages[usage_count++] = item_value(data, n, false);
+			break;
+		case 0x18: usage_minimum = item_value(data, n, false); range = true; break;
+		case 0x28: usage_maximum = item_value(data, n, false); range = true; break;
+
+		default:
+			printf("unknown item 0x%02x at %d\n", prefix, pos - 1 - (int)n);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* The nth variable field with this usage, NULL if there is none */
+static const struct field *
+find(uint16_t page, uint16_t usage, unsigned nth) {
+	const struct field *found = NULL;
+	unsigned i;
+
+	for ( i = 0; i < field_count; i++ )
+		if ( !fields[i].constant && fields[i].page == page && fields[i].usage == usage && nth-- == 0 )
+			found = &fields[i];
+	return found;
+}
+
+static int32_t
+extract(const uint8_t *report, const struct field *f, bool sign) {
+	uint32_t value = 0;
+	unsigned i;
+
+	for ( i = 0; i < f->size; i++ )
+		value |= (uint32_t)((report[(f->bit + i) / 8] >> ((f->bit + i) % 8)) & 1) << i;
+	if ( sign && f->size < 32 && (value & (1u << (f->size - 1))) )
+		value |= ~0u << f->size;
+	return (int32_t)value;
+}
+
+static unsigned errors;
+
+static void
+check(bool ok, const char *what, unsigned index) {
+	if ( !ok && errors++ < 20 )
+		printf("%s %u: wrong\n", what, index);
+}
+
+#define AXIS_PAGE(name, page, usage) page,
+#define AXIS_USAGE(name, page, usage) usage,
+static const uint16_t axis_page[] = { HID_AXES(AXIS_PAGE) };
+static const uint16_t axis_usage[] = { HID_AXES(AXIS_USAGE) };
+
+int
+main(void) {
+	struct usb_setup_data setup = { 0x81, USB_REQ_GET_DESCRIPTOR, 0x2200, 0, 256 };
+	struct Joystick_report report;
+	const struct field *f;
+	uint8_t descriptor[256], packet[64];
+	unsigned i, spins, variables = 0;
+	int descriptor_len;
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	descriptor_len = hostusb_control(&setup, descriptor);
+	if ( descriptor_len <= 0 || !parse(descriptor, descriptor_len) ) {
+		printf("report descriptor: can not parse\nFAIL\n");
+		return 1;
+	}
+
+	/* The layout */
+	check(report_id == HID_REPORT_ID, "report id", 0);
+	check(report_bits == HID_REPORT_SIZE * 8, "report size", report_bits);
+	for ( i = 0; i < HID_BUTTON_COUNT; i++ ) {
+		f = find(0x09, i + 1, 0);
+		check(f && !find(0x09, i + 1, 1) && f->bit == HID_REPORT_BUTTONS_OFFSET * 8 + i && f->size == 1
+		   && f->minimum == 0 && f->maximum == 1, "button", i);
+	}
+#if HID_HAT_COUNT > 0
+	for ( i = 0; i < HID_HAT_COUNT; i++ ) {
+		f = find(0x01, 0x39, i);
+		check(f && f->bit == HID_REPORT_HATS_OFFSET * 8 + 4 * i && f->size == 4
+		   && f->minimum == 0 && f->maximum == 7, "hat", i);
+	}
+#endif
+	check(!find(0x01, 0x39, HID_HAT_COUNT), "hat", HID_HAT_COUNT);
+	for ( i = 0; i < JOYSTICK_AXIS_COUNT; i++ ) {
+		f = find(axis_page[i], axis_usage[i], 0);
+		check(f && !find(axis_page[i], axis_usage[i], 1) && f->bit == HID_REPORT_AXIS_OFFSET(i) * 8 && f->size == 16
+		   && f->minimum == HID_AXIS_MINIMUM && f->maximum == HID_AXIS_MAXIMUM, "axis", i);
+	}
+	for ( i = 0; i < field_count; i++ )
+		variables += !fields[i].constant;
+	check(variables == HID_BUTTON_COUNT + HID_HAT_COUNT + JOYSTICK_AXIS_COUNT, "fields", variables);
+
+	/* A report, decoded with the descriptor */
+	for ( i = 0; i < HID_BUTTON_COUNT; i++ )
+		Joystick_setButton(&joystick, i, i % 3 == 0);
+#if HID_HAT_COUNT > 0
+	for ( i = 0; i < HID_HAT_COUNT; i++ )
+		Joystick_setHat(&joystick, i, i % 2 ? JOYSTICK_HAT_DOWN | JOYSTICK_HAT_LEFT : JOYSTICK_HAT_RIGHT);
+#endif
+	for ( i = 0; i < JOYSTICK_AXIS_COUNT; i++ )
+		Joystick_setAxis(&joystick, i, 100 + 700 * i);
+	Joystick_getReport(&joystick, &report);
+	for ( spins = 0; hostusb_in(0x81, packet) < 0 || memcmp(packet, &report, PACKET_SIZE) != 0; spins++ ) {
+		if ( spins > 1000000 ) {
+			printf("the last report never reached the host\nFAIL\n");
+			return 1;
+		}
+		sched_yield();
+	}
+	for ( i = 0; i < HID_BUTTON_COUNT; i++ )
+		if ( (f = find(0x09, i + 1, 0)) )
+			check(extract(packet, f, false) == ((report.buttons[i / 8] >> (i % 8)) & 1)
+			   && extract(packet, f, false) == (i % 3 == 0), "button value", i);
+#if HID_HAT_COUNT > 0
+	for ( i = 0; i < HID_HAT_COUNT; i++ )
+		if ( (f = find(0x01, 0x39, i)) )
+			check(extract(packet, f, false) == ((report.hats[i / 2] >> (4 * (i % 2))) & 0x0F)
+			   && extract(packet, f, false) == (i % 2 ? 5 : 2), "hat value", i);
+#endif
+	for ( i = 0; i < JOYSTICK_AXIS_COUNT; i++ )
+		if ( (f = find(axis_page[i], axis_usage[i], 0)) )
+			check(extract(packet, f, true) == report.axis[i], "axis value", i);
+
+	printf("%u buttons, %u hats, %u axes: descriptor %d bytes, %u fields, report %u bytes, %u errors\n",
+		HID_BUTTON_COUNT, HID_HAT_COUNT, JOYSTICK_AXIS_COUNT, descriptor_len, field_count, report_bits / 8, errors);
+	if ( errors )
+		printf("FAIL\n");
+	return errors != 0;
+}
+
+// End test_descriptor.c
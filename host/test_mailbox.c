@@ -0,0 +1,137 @@
+/* Host build
+ * Report age under a burst of 1000 setter calls, one every 50 us, while
+ * the host reads the endpoint every millisecond.
+ *
+ * For every report the host reads: how many setter calls behind the
+ * current state it is, and for how long it has been stale (0 if it is
+ * still the current state). With USBHID_TXQ_MAILBOX=1 (test_mailbox) a
+ * report may only be the one loaded into the endpoint at the previous
+ * read, so no older than the state current then. test_mailbox_fifo builds
+ * the same test with the report queue, to compare: its reports fall
+ * behind, but the queue turns the last states away when it is full, and
+ * they must still be published once it has room (Joystick_retryFromISR).
+ * In both, the last state must reach the host.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define BURST		1000
+#define SPACING_US	50
+#define POLL_US		1000
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static uint64_t set_us[BURST];			/* when state i was set */
+static int16_t set_x[BURST];			/* its X axis in the report */
+static volatile int latest = -1;		/* last state set */
+static volatile bool start = false;
+
+static void
+burst_task(void *arg __attribute((unused))) {
+	struct Joystick_batch batch;
+	struct Joystick_report report;
+	uint64_t t;
+	int i;
+
+	while ( !start )
+		vTaskDelay(1);
+	t = host_now_us();
+	for ( i = 0; i < BURST; i++ ) {
+		Joystick_beginUpdate(&joystick, &batch);	/* recorded before the host can read it */
+		Joystick_setXAxis(&joystick, 4 * i);	/* every state is a new report */
+		Joystick_getReport(&joystick, &report);
+		set_x[i] = report.axis[JOYSTICK_AXIS_X];
+		__atomic_store_n(&latest, i, __ATOMIC_RELEASE);
+		set_us[i] = host_now_us();
+		Joystick_commit(&joystick, &batch);
+		t += SPACING_US;
+		host_sleep_until_us(t);
+	}
+	vTaskDelay(portMAX_DELAY);
+}
+
+static int
+state_of(int16_t x) {
+	int i;
+
+	for ( i = 0; i < BURST; i++ )
+		if ( set_x[i] == x )
+			return i;
+	return -1;
+}
+
+int
+main(void) {
+	struct usbhid_stats stats;
+	uint8_t packet[64];
+	uint64_t next, end, now, age, max_age = 0;
+	int state, last_read = -1, now_latest, prev_latest = -1, behind, max_behind = 0, reads = 0, stale = 0;
+	bool ok;
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	xTaskCreate(burst_task,"Burst",configMINIMAL_STACK_SIZE,NULL,configMAX_PRIORITIES-1,NULL);
+
+	start = true;
+	next = host_now_us();
+	end = next + BURST * SPACING_US + 20 * POLL_US;
+	while ( next < end ) {
+		host_sleep_until_us(next);
+		next += POLL_US;
+		now_latest = __atomic_load_n(&latest, __ATOMIC_ACQUIRE);
+		if ( hostusb_in(0x81, packet) < 0 )
+			continue;
+		now = host_now_us();
+		state = state_of(hid_report_axis(packet, JOYSTICK_AXIS_X));
+		/* loaded after the previous read, so at least what was current then */
+		if ( state < prev_latest )
+			++stale;
+		prev_latest = now_latest;
+		if ( state < 0 )
+			continue;		/* the initial report */
+		++reads;
+		last_read = state;
+		behind = now_latest - state;
+		age = behind > 0 ? now - set_us[state + 1] : 0;
+		if ( behind > max_behind )
+			max_behind = behind;
+		if ( age > max_age )
+			max_age = age;
+	}
+
+	usbhid_get_stats(&stats);
+	printf("%s, %d setter calls %d us apart, host read every %d us\n",
+		USBHID_TXQ_MAILBOX ? "mailbox" : "queue", BURST, SPACING_US, POLL_US);
+	printf("%d reports read, last state read %d, worst %d calls behind, worst age %.3f ms\n",
+		reads, last_read, max_behind, max_age / 1000.0);
+	printf("%d reports older than the previous read\n", stale);
+	printf("frames sent %u, dropped %u, coalesced %u, partial %u\n",
+		stats.frames_sent, stats.frames_dropped, stats.frames_coalesced, stats.frames_partial);
+
+	ok = stats.frames_partial == 0 && last_read == BURST - 1;
+#if USBHID_TXQ_MAILBOX
+	/*
+	 * At most the report loaded at the previous read. Checked on the
+	 * states rather than the age: the host threads share one CPU and
+	 * can be stalled for several polls at once.
+	 */
+	ok = ok && stale == 0 && stats.frames_dropped == 0;
+#endif
+	if ( !ok )
+		printf("FAIL\n");
+	return !ok;
+}
+
+// End test_mailbox.c
@@ -0,0 +1,105 @@
+/* Host build
+ * The report queue at the fastest polling interval, USBHID_POLL_MS=1:
+ * a task sets a new state about once a millisecond, and the host reads
+ * the endpoint every millisecond.
+ *
+ * The host must read every state once, in order (the X axis of the
+ * report only grows): no frame dropped, none partial. The queue backlog
+ * is sampled before every read and must stay below USBHID_TXQ_LENGTH,
+ * where the producer would start losing reports, and the queue must be
+ * empty at the end. Polls the host thread missed
+ * are made up at once, a real host controller would not stall.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#if USBHID_POLL_MS != 1
+#error "test_poll1 is built with USBHID_POLL_MS=1"
+#endif
+
+#define STATES		2000
+#define POLL_US		(USBHID_POLL_MS * 1000)
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+static volatile int produced = 0;
+static volatile bool start = false;
+
+static void
+producer_task(void *arg __attribute((unused))) {
+	int i;
+
+	while ( !start )
+		vTaskDelay(1);
+	for ( i = 1; i <= STATES; i++ ) {
+		Joystick_setXAxis(&joystick, i);	/* 0 is the initial state */
+		__atomic_store_n(&produced, i, __ATOMIC_RELEASE);
+		vTaskDelay(pdMS_TO_TICKS(USBHID_POLL_MS));	/* no catch up after a stall */
+	}
+	vTaskDelay(portMAX_DELAY);
+}
+
+int
+main(void) {
+	struct usbhid_stats stats;
+	struct Joystick_report report;
+	uint8_t packet[64];
+	uint64_t next;
+	UBaseType_t backlog, max_backlog = 0;
+	int x, last, reads = 0, out_of_order = 0, naks = 0;
+	bool ok;
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	xTaskCreate(producer_task,"Producer",configMINIMAL_STACK_SIZE,NULL,configMAX_PRIORITIES-1,NULL);
+
+	Joystick_getReport(&joystick, &report);
+	last = report.axis[JOYSTICK_AXIS_X];
+	start = true;
+	next = host_now_us();
+	while ( __atomic_load_n(&produced, __ATOMIC_ACQUIRE) < STATES || naks < 20 ) {
+		host_sleep_until_us(next);
+		next += POLL_US;
+		backlog = uxQueueMessagesWaiting(joystick_txq);
+		if ( backlog > max_backlog )
+			max_backlog = backlog;
+		if ( hostusb_in(0x81, packet) < 0 ) {
+			++naks;
+			continue;
+		}
+		naks = 0;
+		x = hid_report_axis(packet, JOYSTICK_AXIS_X);
+		if ( x <= last && out_of_order++ < 10 )
+			printf("read X %d after %d\n", x, last);
+		last = x;
+		++reads;
+	}
+
+	usbhid_get_stats(&stats);
+	backlog = uxQueueMessagesWaiting(joystick_txq);
+	printf("%d states, host read every %d us: %d reports read, %d out of order\n",
+		STATES, POLL_US, reads, out_of_order);
+	printf("queue backlog max %lu of %d, %lu at the end\n",
+		(unsigned long)max_backlog, USBHID_TXQ_LENGTH, (unsigned long)backlog);
+	printf("frames sent %u, dropped %u, coalesced %u, partial %u\n",
+		stats.frames_sent, stats.frames_dropped, stats.frames_coalesced, stats.frames_partial);
+
+	ok = stats.frames_dropped == 0 && stats.frames_partial == 0 && out_of_order == 0
+	  && reads == STATES && max_backlog < USBHID_TXQ_LENGTH && backlog == 0;
+	if ( !ok )
+		printf("FAIL\n");
+	return !ok;
+}
+
+// End test_poll1.c
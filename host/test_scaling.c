@@ -0,0 +1,72 @@
+/* Host build
+ * Axis scaling: every int16 input, for a set of ranges, against the
+ * divide the joystick used to do per report:
+ *   (value-realMinimum) * (actualMaximum-actualMinimum+1) / (realMaximum-realMinimum+1) + actualMinimum
+ * after clamping, and mirrored for an inverted range. The reference runs
+ * in 64 bit: in int the product overflows for spans above 32768.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static const int16_t ranges[][2] = {
+	{ 0, 4095 }, { 4095, 0 }, { 0, 1023 }, { 0, 16383 }, { 0, 255 },
+	{ -512, 511 }, { -10000, 20000 }, { 1, 2 }, { 7, 7 }, { -1, 0 },
+	{ -32768, 32767 }, { 32767, -32768 }, { -32767, 32767 }, { 0, 32767 },
+	{ -32768, -32768 }, { 32767, 32767 }, { 12345, -23456 },
+};
+
+static int16_t
+reference(int16_t value, int16_t minimum, int16_t maximum) {
+	int64_t low = minimum <= maximum ? minimum : maximum;
+	int64_t high = minimum <= maximum ? maximum : minimum;
+	int64_t v = value;
+
+	if ( v < low )
+		v = low;
+	if ( v > high )
+		v = high;
+	if ( minimum > maximum )
+		v = high - v + low;
+	return (int16_t)((v - low) * (JOYSTICK_AXIS_MAXIMUM - JOYSTICK_AXIS_MINIMUM + 1) / (high - low + 1) + JOYSTICK_AXIS_MINIMUM);
+}
+
+int
+main(void) {
+	struct Joystick_report report;
+	unsigned r, axis, errors = 0, checked = 0;
+	int32_t value;
+	int16_t expected;
+
+	joystick_txq = xQueueCreate(USBHID_TXQ_LENGTH,sizeof(struct usbhid_frame));
+	Joystick_start(&joystick, &joystick_txq);
+
+	for ( r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++ ) {
+		for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ ) {
+			Joystick_setAxisRange(&joystick, axis, ranges[r][0], ranges[r][1]);
+			for ( value = INT16_MIN; value <= INT16_MAX; value++ ) {
+				Joystick_setAxis(&joystick, axis, (int16_t)value);
+				Joystick_getReport(&joystick, &report);
+				expected = reference((int16_t)value, ranges[r][0], ranges[r][1]);
+				++checked;
+				if ( report.axis[axis] != expected && errors++ < 10 )
+					printf("range %d..%d axis %u: %d gives %d, not %d\n", ranges[r][0], ranges[r][1],
+						axis, value, report.axis[axis], expected);
+			}
+			Joystick_setAxisRange(&joystick, axis, JOYSTICK_DEFAULT_AXIS_MINIMUM, JOYSTICK_DEFAULT_AXIS_MAXIMUM);
+		}
+	}
+
+	printf("%u ranges, %u values checked, %u differ\n", r, checked, errors);
+	return errors != 0;
+}
+
+// End test_scaling.c
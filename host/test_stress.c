@@ -0,0 +1,202 @@
+/* Host build
+ * Concurrent producers: 8 threads update the joystick as fast as they
+ * can, half of them as tasks and half from simulated interrupts (FromISR
+ * calls under the interrupt mask), while the host reads the endpoint
+ * every 50 us through usb_task.
+ *
+ * Producer k sets all the axes to one value per call (Joystick_setAxes)
+ * and toggles button k. Every report the host reads must be whole: report
+ * id first and all the axes equal, whatever the interleaving. At the end
+ * every button holds the last value its producer wrote (no lost update),
+ * and every frame numbered by the joystick is either sent or counted as
+ * dropped. Frame numbers are 16 bit, so that count is modulo 65536.
+ *
+ * Then a task holds a batch open while an interrupt sets a button: the
+ * interrupt's report must reach the host before the task commits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+#define PRODUCERS	8
+#define UPDATES		20000
+#define POLL_US		50
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+static volatile bool start = false;
+static volatile int finished = PRODUCERS;	/* until start */
+
+/* what the simulated interrupt of this thread publishes */
+static __thread int16_t isr_value;
+static __thread uint8_t isr_button, isr_pressed;
+
+static void
+producer_isr(void) {
+	BaseType_t woken = pdFALSE;
+	int16_t values[JOYSTICK_AXIS_COUNT];
+	unsigned axis;
+
+	for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+		values[axis] = isr_value;
+	Joystick_setAxesFromISR(&joystick, values, &woken);
+	Joystick_setButtonFromISR(&joystick, isr_button, isr_pressed, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+static void
+producer_task(void *arg) {
+	uintptr_t k = (uintptr_t)arg;
+	int16_t values[JOYSTICK_AXIS_COUNT];
+	unsigned i, axis;
+
+	while ( !start )
+		vTaskDelay(1);
+	for ( i = 0; i < UPDATES; i++ ) {
+		int16_t value = (k * 997 + i * 13) % (JOYSTICK_DEFAULT_AXIS_MAXIMUM + 1);
+
+		if ( k & 1 ) {
+			isr_value = value;
+			isr_button = k;
+			isr_pressed = i & 1;
+			host_interrupt(producer_isr);
+		} else {
+			for ( axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++ )
+				values[axis] = value;
+			Joystick_setAxes(&joystick, values);
+			Joystick_setButton(&joystick, k, i & 1);
+		}
+	}
+	__atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+	vTaskDelay(portMAX_DELAY);
+}
+
+/* The batch case: the task opens a batch and holds it until released */
+static volatile bool batch_open = false, batch_release = false;
+
+static void
+batch_task(void *arg __attribute((unused))) {
+	struct Joystick_batch batch;
+
+	Joystick_beginUpdate(&joystick, &batch);
+	Joystick_setButton(&joystick, 0, 1);
+	batch_open = true;
+	while ( !batch_release )
+		vTaskDelay(1);
+	Joystick_commit(&joystick, &batch);
+	batch_open = false;
+	vTaskDelay(portMAX_DELAY);
+}
+
+static void
+batch_isr(void) {
+	BaseType_t woken = pdFALSE;
+
+	Joystick_setButtonFromISR(&joystick, 7, 1, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * Reads the endpoint every POLL_US until it NAKs for idle_polls in a row
+ * after the producers are done. Returns the bad reports.
+ */
+static unsigned
+read_reports(unsigned idle_polls, uint8_t last[PACKET_SIZE], unsigned *reads) {
+	uint8_t packet[64];
+	uint64_t next = host_now_us();
+	unsigned bad = 0, naks = 0, axis;
+	int len;
+
+	while ( __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < PRODUCERS || naks < idle_polls ) {
+		host_sleep_until_us(next);
+		next += POLL_US;
+		len = hostusb_in(0x81, packet);
+		if ( len < 0 ) {
+			++naks;
+			continue;
+		}
+		naks = 0;
+		++*reads;
+		memcpy(last, packet, PACKET_SIZE);
+		for ( axis = 1; axis < JOYSTICK_AXIS_COUNT; axis++ )
+			if ( hid_report_axis(packet, axis) != hid_report_axis(packet, 0) )
+				break;
+		if ( len != PACKET_SIZE || packet[0] != HID_REPORT_ID || axis != JOYSTICK_AXIS_COUNT ) {
+			if ( bad++ < 10 )
+				printf("torn report: len %d id %u axes %d %d\n", len, packet[0],
+					hid_report_axis(packet, 0), hid_report_axis(packet, axis % JOYSTICK_AXIS_COUNT));
+		}
+	}
+	return bad;
+}
+
+int
+main(void) {
+	struct usbhid_stats stats;
+	struct Joystick_report report;
+	uint8_t last[PACKET_SIZE];
+	unsigned bad, reads = 0, k;
+	uint32_t accounted;
+	bool ok;
+
+	if ( hostusb_start_joystick(&joystick, &joystick_txq, 0) < 0 )
+		return 1;
+	for ( k = 0; k < PRODUCERS; k++ )
+		xTaskCreate(producer_task,"Producer",configMINIMAL_STACK_SIZE,(void *)(uintptr_t)k,configMAX_PRIORITIES-1,NULL);
+
+	/* A first frame, so the frame count starts at number 0 */
+	Joystick_setButtons(&joystick, 0xA5);
+	bad = read_reports(20, last, &reads);
+
+	__atomic_store_n(&finished, 0, __ATOMIC_RELEASE);
+	start = true;
+	bad += read_reports(20, last, &reads);
+
+	/* One more state once the queue is empty: it must be the last frame sent */
+	Joystick_setButtons(&joystick, 0x5A);
+	bad += read_reports(20, last, &reads);
+	Joystick_getReport(&joystick, &report);
+
+	usbhid_get_stats(&stats);
+	accounted = stats.frames_sent + stats.frames_dropped + stats.frames_coalesced;
+	printf("%d producers (%d from interrupts) x %d updates, %s, %u reports read\n", PRODUCERS, PRODUCERS / 2, UPDATES,
+		USBHID_TXQ_MAILBOX ? "mailbox" : "queue", reads);
+	printf("frames sent %u, dropped %u, coalesced %u, partial %u, next frame number %u, torn reports %u\n",
+		stats.frames_sent, stats.frames_dropped, stats.frames_coalesced, stats.frames_partial, joystick._frameSeq, bad);
+
+	ok = bad == 0 && stats.frames_partial == 0 && (uint16_t)accounted == joystick._frameSeq
+	  && memcmp(last, &report, PACKET_SIZE) == 0 && report.buttons[0] == 0x5A
+	  && (!USBHID_TXQ_MAILBOX || stats.frames_dropped == 0);
+
+	/* An interrupt publishes while a task holds a batch open */
+	xTaskCreate(batch_task,"Batch",configMINIMAL_STACK_SIZE,NULL,configMAX_PRIORITIES-1,NULL);
+	while ( !batch_open )
+		vTaskDelay(1);
+	host_interrupt(batch_isr);
+	bad = read_reports(20, last, &reads);
+	memcpy(&report, last, PACKET_SIZE);
+	printf("batch open: interrupt report %s, buttons 0x%02x\n",
+		report.buttons[0] & 0x80 ? "read" : "held back", report.buttons[0]);
+	ok = ok && bad == 0 && (report.buttons[0] & 0x80);
+	batch_release = true;
+	while ( batch_open )
+		vTaskDelay(1);
+	read_reports(20, last, &reads);
+	Joystick_getReport(&joystick, &report);
+	ok = ok && memcmp(last, &report, PACKET_SIZE) == 0 && report.buttons[0] == (0x5A | 0x81);
+	if ( !ok )
+		printf("FAIL\n");
+	return !ok;
+}
+
+// End test_stress.c
@@ -0,0 +1,136 @@
+/* Host build
+ * The firmware's USB side (usbhid.c and joystick.c) on the host, with the
+ * demo tasks of main.c as the report source, read by a scripted USB host:
+ * it enumerates the device, then sends an IN token every poll interval,
+ * as a host controller does for bInterval, and logs every report it gets.
+ *
+ *	usbhost [-t ms] [-p poll_ms] [-i idle_rate] [-q]
+ *
+ * -t	session length after enumeration (default 3000)
+ * -p	IN token interval (default USBHID_POLL_MS)
+ * -i	SET_IDLE rate in 4 ms units (default 0, only on change)
+ * -q	no report log, only the summary
+ *
+ * The CPU figure is the process CPU time over the session, firmware and
+ * scripted host together, in permille of one core: a task that spins
+ * instead of blocking shows as about 1000.
+ *
+ * Exits with 1 when the device did not enumerate, sent no report or sent
+ * a partial one, or when the session used half a core or more.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "../usbhid.h"
+#include "../joystick.h"
+#include "../demo.h"
+
+#include "hostrtos.h"
+#include "hostusb.h"
+
+static QueueHandle_t joystick_txq;
+static struct Joystick_ joystick;
+
+static uint64_t
+cpu_us(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void
+print_report(uint64_t us, const uint8_t *report) {
+	unsigned i;
+
+	printf("%9.3f ms  id %u  buttons", us / 1000.0, report[0]);
+	for ( i = 0; i < HID_BUTTON_COUNT; i++ )
+		putchar(hid_report_button(report, i) ? '1' : '0');
+	for ( i = 0; i < HID_AXIS_COUNT; i++ )
+		printf(" %6d", hid_report_axis(report, i));
+	putchar('\n');
+}
+
+int
+main(int argc, char **argv) {
+	uint32_t duration_ms = 3000, poll_ms = USBHID_POLL_MS;
+	uint8_t idle_rate = 0;
+	bool quiet = false, boot_ok;
+	struct usbhid_stats stats;
+	uint8_t report[64];
+	uint32_t reports = 0, naks = 0, i;
+	uint64_t start, next, end, cpu_start;
+	uint32_t cpu_permille;
+	int32_t step;
+	int opt, len;
+
+	while ( (opt = getopt(argc, argv, "t:p:i:q")) != -1 ) {
+		switch ( opt ) {
+		case 't': duration_ms = strtoul(optarg, NULL, 0); break;
+		case 'p': poll_ms = strtoul(optarg, NULL, 0); break;
+		case 'i': idle_rate = strtoul(optarg, NULL, 0); break;
+		case 'q': quiet = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-t ms] [-p poll_ms] [-i idle_rate] [-q]\n", argv[0]);
+			return 2;
+		}
+	}
+	if ( poll_ms == 0 )
+		poll_ms = 1;
+
+	/* The firmware, set up as main() does, and enumerated */
+	dwt_enable_cycle_counter();
+	usbhid_boot_mark(USBHID_BOOT_RESET);
+	usbhid_boot_mark(USBHID_BOOT_CLOCK);
+	len = hostusb_start_joystick(&joystick, &joystick_txq, idle_rate);
+	if ( len < 0 )
+		return 1;
+	xTaskCreate(axis_demo_task,"xAxis",configMINIMAL_STACK_SIZE,&joystick,configMAX_PRIORITIES-1,NULL);
+	xTaskCreate(buttons_demo_task,"Buttons",configMINIMAL_STACK_SIZE,&joystick,configMAX_PRIORITIES-1,NULL);
+	printf("enumerated, report descriptor %d bytes, report %d bytes\n", len, PACKET_SIZE);
+
+	cpu_start = cpu_us();
+	start = next = host_now_us();
+	end = start + (uint64_t)duration_ms * 1000;
+	while ( next < end ) {
+		host_sleep_until_us(next);
+		len = hostusb_in(0x81, report);
+		if ( len < 0 ) {
+			++naks;
+		} else {
+			++reports;
+			if ( !quiet )
+				print_report(host_now_us() - start, report);
+		}
+		next += (uint64_t)poll_ms * 1000;
+	}
+
+	cpu_permille = (uint32_t)((cpu_us() - cpu_start) * 1000 / (host_now_us() - start));
+
+	usbhid_get_stats(&stats);
+	printf("%u ms, IN every %u ms: %u reports, %u NAK, cpu %u permille\n", duration_ms, poll_ms, reports, naks, cpu_permille);
+	printf("frames sent %u, dropped %u, coalesced %u, partial %u, repeated %u\n",
+		stats.frames_sent, stats.frames_dropped, stats.frames_coalesced, stats.frames_partial, stats.frames_repeated);
+	printf("latency max %u us, pickup max %u us\n",
+		stats.latency_max / (rcc_ahb_frequency / 1000000), stats.pickup_max / (rcc_ahb_frequency / 1000000));
+	/* One time base: the steps only go forward, from the one zeroing in main() */
+	boot_ok = dwt_get_resets() == 1;
+	printf("boot:");
+	for ( i = 1; i < USBHID_BOOT_STEPS; i++ ) {
+		step = (int32_t)(usbhid_boot_cycles[i] - usbhid_boot_cycles[i - 1]);
+		boot_ok = boot_ok && step >= 0;
+		printf(" %+d", step / (int32_t)(rcc_ahb_frequency / 1000));
+	}
+	printf(" ms, cycle counter zeroed %u times\n", dwt_get_resets());
+
+	return reports == 0 || stats.frames_partial != 0 || cpu_permille >= 500 || !boot_ok;
+}
+
+// End usbhost.c
@@ -6,13 +6,91 @@
  * 
  */
 
+#include <string.h>
+
 #include "joystick.h"
 #include "usbhid.h"
 
+#include <task.h>
+#include <libopencm3/cm3/scb.h>
+
+
+
+static int16_t scaleAxisValue(struct Joystick_ *js, uint8_t axis, int16_t axisValue);
+static uint32_t applyCurve(const struct Joystick_curve *curve, uint32_t offset);
+static void Joystick_publish(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken);
+static void Joystick_stateChanged(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken);
+
+/*
+ * Built-in response curves, computed by the compiler
+ */
+#define CURVE_PROGRESSIVE(x) ((x) * (x))
+#define CURVE_DEGRESSIVE(x)  (1 - (1 - (x)) * (1 - (x)))
+#define CURVE_S(x)           ((x) * (x) * (3 - 2 * (x)))
+#define CURVE_EXPO(x)        (0.5 + 4 * ((x) - 0.5) * ((x) - 0.5) * ((x) - 0.5))
+
+const struct Joystick_curve Joystick_curveProgressive = JOYSTICK_CURVE(CURVE_PROGRESSIVE);
+const struct Joystick_curve Joystick_curveDegressive = JOYSTICK_CURVE(CURVE_DEGRESSIVE);
+const struct Joystick_curve Joystick_curveS = JOYSTICK_CURVE(CURVE_S);
+const struct Joystick_curve Joystick_curveExpo = JOYSTICK_CURVE(CURVE_EXPO);
+
+/*
+ * Concurrency
+ * 
+ * Any number of tasks and ISRs (up to configMAX_SYSCALL_INTERRUPT_PRIORITY)
+ * may update the same joystick. Writers change the state inside a short
+ * BASEPRI section and bump _seq around it, seqlock style (_seq is odd while
+ * a write is in progress). Readers copy the report without masking anything
+ * and retry if _seq moved under them. Nothing here ever waits.
+ * 
+ * Every publishing call has a FromISR variant for interrupt handlers: it
+ * only reports through higherPriorityTaskWoken that usb_task was woken, the
+ * handler then ends with portYIELD_FROM_ISR(). The plain variants yield
+ * themselves and must only be called from tasks. Joystick_beginUpdate() and
+ * Joystick_setAxisRange() publish nothing and are safe from both.
+ * 
+ */
+static inline void Joystick_yield(BaseType_t higherPriorityTaskWoken)
+{
+	if (higherPriorityTaskWoken == pdTRUE)
+		taskYIELD();
+}
+
+static inline UBaseType_t Joystick_writeBegin(struct Joystick_ *js)
+{
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+	js->_seq++;
+	js->_changeCycles = usbhid_cycles();	// start of the latency measurement, see usbhid_stats
+	return mask;
+}
+
+static inline void Joystick_writeEnd(struct Joystick_ *js, UBaseType_t mask)
+{
+	js->_seq++;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/**
+ * Joystick_getReport
+ * 
+ * Takes a consistent copy of the current report without blocking writers.
+ * Returns the state sequence number of the copy.
+ * 
+ */
+uint32_t Joystick_getReport(struct Joystick_ *js, struct Joystick_report *report)
+{
+	uint32_t seq;
 
+	do {
+		seq = js->_seq;
+		portMEMORY_BARRIER();
+		memcpy(report, (const void *)&js->_report, sizeof(*report));
+		portMEMORY_BARRIER();
+	} while ((seq & 1) || seq != js->_seq);
 
-int buildAndSet16BitValue(int16_t value, int16_t valueMinimum, int16_t valueMaximum, int16_t actualMinimum, int16_t actualMaximum, uint8_t dataLocation[]);
-int buildAndSetAxisValue(int16_t axisValue, int16_t axisMinimum, int16_t axisMaximum, uint8_t dataLocation[]);
+	return seq;
+}
 
 /**
  * Joystick_ start
@@ -22,211 +100,598 @@ int buildAndSetAxisValue(int16_t axisValue, int16_t axisMinimum, int16_t axisMax
  */
 void Joystick_start(struct Joystick_ *js, QueueHandle_t *queue)
 {
+	uint8_t axis;
+
     //joystick state
-	js->buttons = 0;
-	js->xAxis = 0;
-	js->yAxis = 0;
-	js->zAxis = 0;
-	js->wheel = 0;
-	js->gas = 0;
-	js->brake = 0;
-
-    //joystick limits
-	js->_xAxisMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_xAxisMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
-	js->_yAxisMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_yAxisMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
-	js->_zAxisMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_zAxisMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
-	js->_acceleratorMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_acceleratorMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
-	js->_brakeMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_brakeMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
-	js->_steeringMinimum = JOYSTICK_DEFAULT_AXIS_MINIMUM;
-	js->_steeringMaximum = JOYSTICK_DEFAULT_AXIS_MAXIMUM;
+	memset(&js->_report, 0, sizeof(js->_report));
+	js->_report.reportId = JOYSTICK_DEFAULT_REPORT_ID;
+	memset(js->_buttons, 0, sizeof(js->_buttons));
+#if HID_HAT_COUNT > 0
+	memset(js->_report.hats, HID_HAT_CENTERED | (HID_HAT_CENTERED << 4), sizeof(js->_report.hats));
+#endif
+	memset(js->_axisValue, 0, sizeof(js->_axisValue));
+
+	memset(js->_axisCurve, 0, sizeof(js->_axisCurve));
+
+    //joystick limits, this also packs the initial axis values
+	for (axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++)
+	{
+		Joystick_setAxisRange(js, axis, JOYSTICK_DEFAULT_AXIS_MINIMUM, JOYSTICK_DEFAULT_AXIS_MAXIMUM);
+	}
+
+	js->_batches = NULL;
+
+	js->_seq = 0;
+	js->_publishedSeq = 0;
+	js->_publishPending = false;
+	js->_frameSeq = 0;
+	js->_changeCycles = 0;
+	js->_lastReportValid = false;
+	js->_reportsSent = 0;
+	js->_reportsSuppressed = 0;
 
 	js->js_txq = queue;
 
 }
 
-int buildAndSet16BitValue(int16_t value, int16_t valueMinimum, int16_t valueMaximum, int16_t actualMinimum, int16_t actualMaximum, uint8_t dataLocation[])
+/**
+ * Joystick_setAxisRange
+ * 
+ * Precomputes the mapping of minimum..maximum onto
+ * JOYSTICK_AXIS_MINIMUM..JOYSTICK_AXIS_MAXIMUM:
+ *   (value-realMinimum) * (actualMaximum-actualMinimum+1) / (realMaximum-realMinimum+1) + actualMinimum
+ * The ratio is stored as whole + fraction/2^32, with the fraction rounded up.
+ * As value-realMinimum < realMaximum-realMinimum+1 <= 65536 the rounding error
+ * never reaches the next integer, so the result is bit-exact with the divide.
+ * 
+ */
+void Joystick_setAxisRange(struct Joystick_ *js, uint8_t axis, int16_t minimum, int16_t maximum)
 {
-	int16_t convertedValue;
-	uint8_t highByte;
-	uint8_t lowByte;
-	int16_t realMinimum = valueMinimum<=valueMaximum?valueMinimum:valueMaximum; // min(valueMinimum, valueMaximum);
-	int16_t realMaximum = valueMinimum<=valueMaximum?valueMaximum:valueMinimum; //max(valueMinimum, valueMaximum);
+	uint32_t span;
+	uint32_t actualSpan = JOYSTICK_AXIS_MAXIMUM - JOYSTICK_AXIS_MINIMUM + 1;
+	bool inverted = minimum > maximum; // values go from a larger number to a smaller number (e.g. 1024 to 0)
+
+	UBaseType_t mask;
 
+	if (axis >= JOYSTICK_AXIS_COUNT) return;
 
-	if (value < realMinimum) {
-		value = realMinimum;
+	mask = Joystick_writeBegin(js);
+	js->_axisInverted[axis] = inverted;
+	js->_axisMinimum[axis] = inverted ? maximum : minimum;
+	js->_axisMaximum[axis] = inverted ? minimum : maximum;
+
+	span = (uint32_t)(js->_axisMaximum[axis] - js->_axisMinimum[axis]) + 1;
+	js->_axisWhole[axis] = actualSpan / span;
+	js->_axisFraction[axis] = (uint32_t)((((uint64_t)(actualSpan % span) << 32) + span - 1) / span);
+
+	js->_report.axis[axis] = scaleAxisValue(js, axis, js->_axisValue[axis]);
+	Joystick_writeEnd(js, mask);
+}
+
+static int16_t scaleAxisValue(struct Joystick_ *js, uint8_t axis, int16_t axisValue)
+{
+	uint32_t offset;
+
+	if (axisValue < js->_axisMinimum[axis]) {
+		axisValue = js->_axisMinimum[axis];
 	}
-	if (value > realMaximum) {
-		value = realMaximum;
+	if (axisValue > js->_axisMaximum[axis]) {
+		axisValue = js->_axisMaximum[axis];
 	}
 
-	if (valueMinimum > valueMaximum) {
-		// Values go from a larger number to a smaller number (e.g. 1024 to 0)
-		value = realMaximum - value + realMinimum;
-	}
+	offset = js->_axisInverted[axis] ? (uint32_t)(js->_axisMaximum[axis] - axisValue) : (uint32_t)(axisValue - js->_axisMinimum[axis]);
+	offset = offset * js->_axisWhole[axis] + (uint32_t)(((uint64_t)offset * js->_axisFraction[axis]) >> 32);
 
-	convertedValue = (value-realMinimum) * (actualMaximum - actualMinimum +1) / (realMaximum-realMinimum+1) + actualMinimum; //map(value, realMinimum, realMaximum, actualMinimum, actualMaximum);
+	if (js->_axisCurve[axis] != NULL)
+		offset = applyCurve(js->_axisCurve[axis], offset);
 
-	highByte = (uint8_t)(convertedValue >> 8);
-	lowByte = (uint8_t)(convertedValue & 0x00FF);
-	
-	dataLocation[0] = lowByte;
-	dataLocation[1] = highByte;
-	
-	return 2;
+	return (int16_t)(offset + JOYSTICK_AXIS_MINIMUM);
 }
 
-int buildAndSetAxisValue(int16_t axisValue, int16_t axisMinimum, int16_t axisMaximum, uint8_t dataLocation[])
+/*
+ * Offset (0..JOYSTICK_CURVE_SPAN) to curve position (0..65536), where the
+ * points sit 1 << JOYSTICK_CURVE_SEGMENT_SHIFT apart: the factor
+ * 65536 / JOYSTICK_CURVE_SPAN with 16 fraction bits
+ */
+#define CURVE_POSITION_SCALE ((65536ull * 65536 + JOYSTICK_CURVE_SPAN / 2) / JOYSTICK_CURVE_SPAN)
+
+/*
+ * Maps a scaled offset (0..JOYSTICK_CURVE_SPAN) through a curve: the top
+ * bits of its position select the segment, the rest interpolate between
+ * its two points
+ */
+static uint32_t applyCurve(const struct Joystick_curve *curve, uint32_t offset)
 {
-    return buildAndSet16BitValue(axisValue, axisMinimum, axisMaximum, JOYSTICK_AXIS_MINIMUM, JOYSTICK_AXIS_MAXIMUM, dataLocation);
+	uint32_t position = (uint32_t)((offset * CURVE_POSITION_SCALE + 32768) >> 16);
+	uint32_t segment = position >> JOYSTICK_CURVE_SEGMENT_SHIFT;
+	int32_t fraction = (int32_t)(position & ((1 << JOYSTICK_CURVE_SEGMENT_SHIFT) - 1));
+	int32_t from, to;
+
+	if (segment >= JOYSTICK_CURVE_SEGMENTS)		// full travel
+	{
+		offset = curve->point[JOYSTICK_CURVE_SEGMENTS];
+	}
+	else
+	{
+		from = curve->point[segment];
+		to = curve->point[segment + 1];
+		offset = (uint32_t)(from + (((to - from) * fraction + (1 << (JOYSTICK_CURVE_SEGMENT_SHIFT - 1))) >> JOYSTICK_CURVE_SEGMENT_SHIFT));
+	}
+	return offset > JOYSTICK_CURVE_SPAN ? JOYSTICK_CURVE_SPAN : offset;
 }
 
+/**
+ * Joystick_setAxisCurve
+ * 
+ * Sets the response curve of an axis, NULL for linear. The curve is used
+ * in place, so a curve built in RAM must stay valid (and unchanged) while
+ * it is set: set another one to change it.
+ * 
+ */
+void Joystick_setAxisCurve(struct Joystick_ *js, uint8_t axis, const struct Joystick_curve *curve)
+{
+	UBaseType_t mask;
+
+	if (axis >= JOYSTICK_AXIS_COUNT) return;
+
+	mask = Joystick_writeBegin(js);
+	js->_axisCurve[axis] = curve;
+	js->_report.axis[axis] = scaleAxisValue(js, axis, js->_axisValue[axis]);
+	Joystick_writeEnd(js, mask);
+}
 
-void Joystick_setXAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+void Joystick_sendState(struct Joystick_ *js)
 {
-	js->_xAxisMinimum = minimum;
-	js->_xAxisMaximum = maximum;
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_publish(js, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
 }
 
-void Joystick_setYAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+void Joystick_sendStateFromISR(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken)
 {
-	js->_yAxisMinimum = minimum;
-	js->_yAxisMaximum = maximum;
+	Joystick_publish(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setZAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+/*
+ * Joystick_publish
+ * 
+ * Queues a snapshot of the report. Comparing and queueing happen in one
+ * masked section, and a snapshot older than the last one published is
+ * dropped, so reports always reach the queue whole and in state order.
+ * When the queue is full the state is marked pending and published again
+ * by Joystick_retryFromISR() as soon as usb_task takes a frame.
+ * The FromISR queue calls only raise BASEPRI, which is also fine from a task.
+ * 
+ */
+static void Joystick_publish(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken)
 {
-	js->_zAxisMinimum = minimum;
-	js->_zAxisMaximum = maximum;
+	struct usbhid_frame frame;
+	struct Joystick_report *report = (struct Joystick_report *)frame.data;
+	uint32_t seq;
+	UBaseType_t mask;
+	BaseType_t queued;
+
+	if(!usbhid_ready()) return;
+
+	seq = Joystick_getReport(js, report);
+	frame.len = sizeof(*report);
+
+	mask = taskENTER_CRITICAL_FROM_ISR();
+	frame.cycles = js->_changeCycles;
+
+	if ((int32_t)(seq - js->_publishedSeq) < 0)
+	{
+		// a newer state has already been published
+	}
+	// Skip a report identical to the last one sent, usb_task refreshes it
+	else if(js->_lastReportValid && memcmp(report, &js->_lastReport, sizeof(*report)) == 0)
+	{
+		js->_reportsSuppressed++;
+	}
+	else
+	{
+		// The whole report travels as a single queue item, numbered even if
+		// it does not fit so usb_task can count the loss
+		frame.seq = js->_frameSeq++;
+#if USBHID_TXQ_MAILBOX
+		queued = xQueueOverwriteFromISR(*(js->js_txq), &frame, higherPriorityTaskWoken);	// newest state replaces any unsent one
+#else
+		queued = xQueueSendFromISR(*(js->js_txq), &frame, higherPriorityTaskWoken);
+#endif
+		if (queued == pdPASS)
+		{
+			js->_lastReport = *report;
+			js->_lastReportValid = true;
+			js->_publishedSeq = seq;
+			js->_reportsSent++;
+		}
+		js->_publishPending = queued != pdPASS;
+	}
+
+	taskEXIT_CRITICAL_FROM_ISR(mask);
 }
 
-void Joystick_setAcceleratorRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+/**
+ * Joystick_retryFromISR
+ * 
+ * Publishes the current state if a full queue turned the last attempt
+ * away. Give it to usbhid_set_queue_space(): it runs in the USB interrupt
+ * each time a frame leaves the queue.
+ * 
+ */
+void Joystick_retryFromISR(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken)
 {
-	js->_acceleratorMinimum = minimum;
-	js->_acceleratorMaximum = maximum;
+	bool pending;
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+	pending = js->_publishPending;
+	js->_publishPending = false;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (pending)
+		Joystick_publish(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setBrakeRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+uint32_t Joystick_getReportsSent(struct Joystick_ *js)
 {
-	js->_brakeMinimum = minimum;
-	js->_brakeMaximum = maximum;
+	return js->_reportsSent;
+}
 
+uint32_t Joystick_getReportsSuppressed(struct Joystick_ *js)
+{
+	return js->_reportsSuppressed;
 }
 
-void Joystick_setSteeringRange(struct Joystick_ *js, int16_t minimum, int16_t maximum)
+/**
+ * Joystick_ batch updates
+ * 
+ * Field changes a producer makes between Joystick_beginUpdate() and
+ * Joystick_commit() are published as a single report when its outermost
+ * commit is reached. Calls may be nested, each with its own batch.
+ * A producer is a task or an interrupt handler, and a batch only holds
+ * back the producer that opened it: other tasks and interrupts still
+ * publish at once, with whatever the open batch has changed so far.
+ * A handler commits its batches before it returns.
+ * 
+ */
+static inline void *Joystick_producer(void)
 {
-	js->_steeringMinimum = minimum;
-	js->_steeringMaximum = maximum;
+	uint32_t active = SCB_ICSR & SCB_ICSR_VECTACTIVE;
+
+	if (active != 0)
+		return (void *)(uintptr_t)active;	// exception number, never a task handle
+	return xTaskGetCurrentTaskHandle();
 }
 
-void Joystick_sendState(struct Joystick_ *js)
+// Called masked
+static struct Joystick_batch *Joystick_findBatch(struct Joystick_ *js, void *producer)
 {
-	uint8_t data[PACKET_SIZE];
-	int index = 0;
-    int x;
-	
-    data[index] = JOYSTICK_DEFAULT_REPORT_ID;
-    index++;
-	// Load Button State
-	data[index] = js->buttons;
-    index++;
+	struct Joystick_batch *batch;
 
-	// Set Axis Values
-	index += buildAndSetAxisValue(js->xAxis, js->_xAxisMinimum, js->_xAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(js->yAxis, js->_yAxisMinimum, js->_yAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(js->zAxis, js->_zAxisMinimum, js->_zAxisMaximum, &(data[index]));
-	
-	// Set Simulation Values
-	index += buildAndSetAxisValue(js->gas, js->_acceleratorMinimum, js->_acceleratorMaximum, &(data[index]));
-	index += buildAndSetAxisValue(js->brake, js->_brakeMinimum, js->_brakeMaximum, &(data[index]));
-	index += buildAndSetAxisValue(js->wheel, js->_steeringMinimum, js->_steeringMaximum, &(data[index]));
+	for (batch = js->_batches; batch != NULL; batch = batch->next)
+		if (batch->producer == producer)
+			break;
+	return batch;
+}
 
-    if(usbhid_ready() && uxQueueSpacesAvailable(*(js->js_txq)) >= PACKET_SIZE)
-	    for ( x=0; x<index; ++x ) 
-        {
-		    // Send data to the tx queue
-		    xQueueSend(*(js->js_txq),&data[x],0);
-	    }
+void Joystick_beginUpdate(struct Joystick_ *js, struct Joystick_batch *batch)
+{
+	UBaseType_t mask;
+
+	batch->producer = Joystick_producer();
+	batch->pending = false;
+	mask = taskENTER_CRITICAL_FROM_ISR();
+	batch->next = js->_batches;
+	js->_batches = batch;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
 
+void Joystick_commitFromISR(struct Joystick_ *js, struct Joystick_batch *batch, BaseType_t *higherPriorityTaskWoken)
+{
+	struct Joystick_batch **link, *outer;
+	bool publish = false;
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+	for (link = &js->_batches; *link != NULL; link = &(*link)->next)
+		if (*link == batch)
+		{
+			*link = batch->next;
+			break;
+		}
+	if (batch->pending)
+	{
+		outer = Joystick_findBatch(js, batch->producer);
+		if (outer != NULL)
+			outer->pending = true;	// nested, the outer commit publishes
+		else
+			publish = true;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (publish)
+		Joystick_publish(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setXAxis(struct Joystick_ *js, int16_t value)
+void Joystick_commit(struct Joystick_ *js, struct Joystick_batch *batch)
 {
-	js->xAxis = value;
-	Joystick_sendState(js);
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_commitFromISR(js, batch, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
 }
 
-void Joystick_setYAxis(struct Joystick_ *js, int16_t value)
+static void Joystick_stateChanged(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken)
 {
-	js->yAxis = value;
-	Joystick_sendState(js);
+	struct Joystick_batch *batch = NULL;
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+	if (js->_batches != NULL)
+	{
+		batch = Joystick_findBatch(js, Joystick_producer());
+		if (batch != NULL)
+			batch->pending = true;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (batch == NULL)
+		Joystick_publish(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setZAxis(struct Joystick_ *js, int16_t value)
+void Joystick_setAxisFromISR(struct Joystick_ *js, uint8_t axis, int16_t value, BaseType_t *higherPriorityTaskWoken)
 {
-	js->zAxis = value;
-	Joystick_sendState(js);
+	UBaseType_t mask;
+
+	if (axis >= JOYSTICK_AXIS_COUNT) return;
+
+	mask = Joystick_writeBegin(js);
+	js->_axisValue[axis] = value;
+	js->_report.axis[axis] = scaleAxisValue(js, axis, value);
+	Joystick_writeEnd(js, mask);
+	Joystick_stateChanged(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setAccelerator(struct Joystick_ *js, int16_t value)
+void Joystick_setAxis(struct Joystick_ *js, uint8_t axis, int16_t value)
 {
-	js->gas = value;
-	Joystick_sendState(js);
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setAxisFromISR(js, axis, value, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
 }
 
-void Joystick_setBrake(struct Joystick_ *js, int16_t value)
+/**
+ * Joystick_setAxes
+ * 
+ * Sets all JOYSTICK_AXIS_COUNT axes at once (e.g. from an ADC scan buffer)
+ * and publishes a single report
+ * 
+ */
+void Joystick_setAxesFromISR(struct Joystick_ *js, const int16_t values[JOYSTICK_AXIS_COUNT], BaseType_t *higherPriorityTaskWoken)
 {
-	js->brake = value;
-	Joystick_sendState(js);
+	uint8_t axis;
+	UBaseType_t mask;
+
+	mask = Joystick_writeBegin(js);
+	memcpy(js->_axisValue, values, sizeof(js->_axisValue));
+	for (axis = 0; axis < JOYSTICK_AXIS_COUNT; axis++)
+	{
+		js->_report.axis[axis] = scaleAxisValue(js, axis, values[axis]);
+	}
+	Joystick_writeEnd(js, mask);
+	Joystick_stateChanged(js, higherPriorityTaskWoken);
 }
 
-void Joystick_setSteering(struct Joystick_ *js, int16_t value)
+void Joystick_setAxes(struct Joystick_ *js, const int16_t values[JOYSTICK_AXIS_COUNT])
 {
-    js->wheel = value;
-	Joystick_sendState(js);
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setAxesFromISR(js, values, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
 }
 
-void Joystick_setButton(struct Joystick_ *js, uint8_t button, uint8_t value)
+void Joystick_setButtonFromISR(struct Joystick_ *js, uint8_t button, uint8_t value, BaseType_t *higherPriorityTaskWoken)
 {
 	if (value == 0)
 	{
-		Joystick_releaseButton(js, button);
+		Joystick_releaseButtonFromISR(js, button, higherPriorityTaskWoken);
 	}
 	else
 	{
-		Joystick_pressButton(js, button);
+		Joystick_pressButtonFromISR(js, button, higherPriorityTaskWoken);
 	}
 }
 
+void Joystick_setButton(struct Joystick_ *js, uint8_t button, uint8_t value)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setButtonFromISR(js, button, value, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+
+void Joystick_pressButtonFromISR(struct Joystick_ *js, uint8_t button, BaseType_t *higherPriorityTaskWoken)
+{
+	if (button >= HID_BUTTON_COUNT) return;
+
+	Joystick_setButtonMaskFromISR(js, button / 32, (uint32_t)1 << (button % 32), 0xFFFFFFFF, higherPriorityTaskWoken);
+}
+
 void Joystick_pressButton(struct Joystick_ *js, uint8_t button)
 {
-    if (button >= JOYSTICK_DEFAULT_BUTTON_COUNT) return;
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_pressButtonFromISR(js, button, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
 
-    int bit = button % 8;
+void Joystick_releaseButtonFromISR(struct Joystick_ *js, uint8_t button, BaseType_t *higherPriorityTaskWoken)
+{
+	if (button >= HID_BUTTON_COUNT) return;
 
-	js->buttons |= (0x01<<bit);
-	Joystick_sendState(js);
+	Joystick_setButtonMaskFromISR(js, button / 32, (uint32_t)1 << (button % 32), 0, higherPriorityTaskWoken);
 }
 
 void Joystick_releaseButton(struct Joystick_ *js, uint8_t button)
 {
-    if (button >= JOYSTICK_DEFAULT_BUTTON_COUNT) return;
-
-    int bit = button % 8;
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
 
-    js->buttons &= ~(0x01<<bit);
+	Joystick_releaseButtonFromISR(js, button, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
 
-	Joystick_sendState(js);
+/**
+ * Joystick_setButtons
+ * 
+ * Sets buttons 0..7 at once
+ * 
+ */
+void Joystick_setButtonsFromISR(struct Joystick_ *js, uint8_t btns, BaseType_t *higherPriorityTaskWoken)
+{
+	Joystick_setButtonMaskFromISR(js, 0, 0xFF, btns, higherPriorityTaskWoken);
 }
 
 void Joystick_setButtons(struct Joystick_ *js, uint8_t btns)
 {
-    js->buttons = btns;
-    Joystick_sendState(js);
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setButtonsFromISR(js, btns, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+
+/**
+ * Joystick_setButtonWord
+ * 
+ * Sets buttons 32*word .. 32*word+31 at once, e.g. from a shift register scan.
+ * Bit n of value is button 32*word+n.
+ * 
+ */
+void Joystick_setButtonWordFromISR(struct Joystick_ *js, uint8_t word, uint32_t value, BaseType_t *higherPriorityTaskWoken)
+{
+	Joystick_setButtonMaskFromISR(js, word, 0xFFFFFFFF, value, higherPriorityTaskWoken);
 }
 
+void Joystick_setButtonWord(struct Joystick_ *js, uint8_t word, uint32_t value)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setButtonWordFromISR(js, word, value, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+
+/**
+ * Joystick_setButtonMask
+ * 
+ * Same as Joystick_setButtonWord, but only the buttons whose bit is set in
+ * mask are changed
+ * 
+ */
+void Joystick_setButtonMaskFromISR(struct Joystick_ *js, uint8_t word, uint32_t mask, uint32_t value, BaseType_t *higherPriorityTaskWoken)
+{
+	UBaseType_t interruptMask;
+
+	if (word >= JOYSTICK_BUTTON_WORDS) return;
+
+	if (word == JOYSTICK_BUTTON_WORDS - 1 && HID_BUTTON_COUNT % 32 != 0)
+		mask &= ((uint32_t)1 << (HID_BUTTON_COUNT % 32)) - 1;	// no bits past the last button
+
+	interruptMask = Joystick_writeBegin(js);
+	js->_buttons[word] = (js->_buttons[word] & ~mask) | (value & mask);
+	// The bitmap words are little-endian, so their bytes are the report bytes
+	memcpy(js->_report.buttons, js->_buttons, HID_BUTTON_BYTES);
+	Joystick_writeEnd(js, interruptMask);
+	Joystick_stateChanged(js, higherPriorityTaskWoken);
+}
+
+void Joystick_setButtonMask(struct Joystick_ *js, uint8_t word, uint32_t mask, uint32_t value)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setButtonMaskFromISR(js, word, mask, value, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+
+#if HID_HAT_COUNT > 0
+/*
+ * Hat value for each combination of the raw JOYSTICK_HAT_* direction bits.
+ * Opposite directions cancel out: three pressed directions give the middle
+ * one, all four (or none) give centered.
+ */
+static const uint8_t hatFromDirections[16] =
+{
+	HID_HAT_CENTERED, // none
+	0,                // up
+	2,                // right
+	1,                // up right
+	4,                // down
+	HID_HAT_CENTERED, // up down
+	3,                // right down
+	2,                // up right down
+	6,                // left
+	7,                // up left
+	HID_HAT_CENTERED, // right left
+	0,                // up right left
+	5,                // down left
+	6,                // up down left
+	4,                // right down left
+	HID_HAT_CENTERED, // all
+};
+
+/**
+ * Joystick_setHat
+ * 
+ * Sets a hat from its raw JOYSTICK_HAT_UP/RIGHT/DOWN/LEFT bits
+ * 
+ */
+void Joystick_setHatFromISR(struct Joystick_ *js, uint8_t hat, uint8_t directions, BaseType_t *higherPriorityTaskWoken)
+{
+	uint8_t shift;
+	UBaseType_t mask;
+
+	if (hat >= HID_HAT_COUNT) return;
+
+	shift = 4 * (hat % 2);
+	mask = Joystick_writeBegin(js);
+	js->_report.hats[hat / 2] = (js->_report.hats[hat / 2] & ~(0x0F << shift)) | (hatFromDirections[directions & 0x0F] << shift);
+	Joystick_writeEnd(js, mask);
+	Joystick_stateChanged(js, higherPriorityTaskWoken);
+}
+
+void Joystick_setHat(struct Joystick_ *js, uint8_t hat, uint8_t directions)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setHatFromISR(js, hat, directions, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+
+/**
+ * Joystick_setHats
+ * 
+ * Sets all hats at once: bits 4n..4n+3 of directions are the raw
+ * direction bits of hat n, as they come from a button matrix scan
+ * 
+ */
+void Joystick_setHatsFromISR(struct Joystick_ *js, uint16_t directions, BaseType_t *higherPriorityTaskWoken)
+{
+	uint8_t hat;
+	UBaseType_t mask;
+
+	directions &= (uint16_t)((1UL << (4 * HID_HAT_COUNT)) - 1);	// keep an odd padding nibble centered
+	mask = Joystick_writeBegin(js);
+	for (hat = 0; hat < HID_HAT_COUNT; hat += 2)
+	{
+		js->_report.hats[hat / 2] = hatFromDirections[(directions >> (4 * hat)) & 0x0F]
+			| (hatFromDirections[(directions >> (4 * hat + 4)) & 0x0F] << 4);
+	}
+	Joystick_writeEnd(js, mask);
+	Joystick_stateChanged(js, higherPriorityTaskWoken);
+}
+
+void Joystick_setHats(struct Joystick_ *js, uint16_t directions)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	Joystick_setHatsFromISR(js, directions, &higherPriorityTaskWoken);
+	Joystick_yield(higherPriorityTaskWoken);
+}
+#endif
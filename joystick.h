@@ -17,64 +17,215 @@
 
 #include <stdbool.h>
 
-#define JOYSTICK_DEFAULT_REPORT_ID         0x03
-#define JOYSTICK_DEFAULT_BUTTON_COUNT         8
+#include "hidlayout.h"
+
+#define JOYSTICK_DEFAULT_REPORT_ID         HID_REPORT_ID
+#define JOYSTICK_DEFAULT_BUTTON_COUNT      HID_BUTTON_COUNT
+#define JOYSTICK_BUTTON_WORDS              ((HID_BUTTON_COUNT + 31) / 32)
 #define JOYSTICK_DEFAULT_AXIS_MINIMUM         0
 #define JOYSTICK_DEFAULT_AXIS_MAXIMUM      4095
-#define JOYSTICK_AXIS_MINIMUM -32767
-#define JOYSTICK_AXIS_MAXIMUM 32767
+#define JOYSTICK_AXIS_MINIMUM HID_AXIS_MINIMUM
+#define JOYSTICK_AXIS_MAXIMUM HID_AXIS_MAXIMUM
+
+#define _HIDREPORTSIZE HID_REPORT_SIZE
+
+// Identical reports are not sent again. When nothing has been sent for
+// JOYSTICK_HEARTBEAT_MS, usb_task sends the last report again so the host
+// still gets a periodic refresh (0 = never)
+#ifndef JOYSTICK_HEARTBEAT_MS
+#define JOYSTICK_HEARTBEAT_MS 1000
+#endif
 
-#define _HIDREPORTSIZE 14
+// Raw hat directions, given to Joystick_setHat
+#define JOYSTICK_HAT_UP                    0x1
+#define JOYSTICK_HAT_RIGHT                 0x2
+#define JOYSTICK_HAT_DOWN                  0x4
+#define JOYSTICK_HAT_LEFT                  0x8
+
+// Axes, in report order: JOYSTICK_AXIS_X, JOYSTICK_AXIS_Y, ... (see HID_AXES)
+#define JOYSTICK_AXIS_ENUM(name, page, usage) JOYSTICK_AXIS_##name,
+enum { HID_AXES(JOYSTICK_AXIS_ENUM) };
+#define JOYSTICK_AXIS_COUNT HID_AXIS_COUNT
+
+/**
+ * Response curve: JOYSTICK_CURVE_POINTS output values, evenly spaced over
+ * the axis travel, linearly interpolated in between. Point i is the
+ * output offset (0..JOYSTICK_CURVE_SPAN above JOYSTICK_AXIS_MINIMUM) for
+ * an input at i/(JOYSTICK_CURVE_POINTS-1) of the travel.
+ * JOYSTICK_CURVE_SEGMENT_SHIFT 10..13 gives 64..8 segments (default 32).
+ */
+#ifndef JOYSTICK_CURVE_SEGMENT_SHIFT
+#define JOYSTICK_CURVE_SEGMENT_SHIFT       11
+#endif
+#define JOYSTICK_CURVE_SEGMENTS            (65536 >> JOYSTICK_CURVE_SEGMENT_SHIFT)
+#define JOYSTICK_CURVE_POINTS              (JOYSTICK_CURVE_SEGMENTS + 1)
+#define JOYSTICK_CURVE_SPAN                (JOYSTICK_AXIS_MAXIMUM - JOYSTICK_AXIS_MINIMUM)
+
+struct Joystick_curve
+{
+	uint16_t point[JOYSTICK_CURVE_POINTS];
+};
+
+// Build a curve at compile time from f(x), x and f(x) in 0..1, e.g.
+//   #define MY_CURVE(x) ((x) * (x))
+//   static const struct Joystick_curve myCurve = JOYSTICK_CURVE(MY_CURVE);
+#define JOYSTICK_CURVE_POINT(f, i) \
+	((uint16_t)((f((i) / (double)(JOYSTICK_CURVE_POINTS - 1))) * JOYSTICK_CURVE_SPAN + 0.5))
+#define JOYSTICK_CURVE(f) {{ JOYSTICK_CURVE_FROM(f, 0) JOYSTICK_CURVE_POINT(f, JOYSTICK_CURVE_SEGMENTS) }}
+
+// JOYSTICK_CURVE_Pn(f, i): points i..i+n-1, each followed by a comma
+#define JOYSTICK_CURVE_P1(f, i)  JOYSTICK_CURVE_POINT(f, i),
+#define JOYSTICK_CURVE_P2(f, i)  JOYSTICK_CURVE_P1(f, i) JOYSTICK_CURVE_P1(f, (i) + 1)
+#define JOYSTICK_CURVE_P4(f, i)  JOYSTICK_CURVE_P2(f, i) JOYSTICK_CURVE_P2(f, (i) + 2)
+#define JOYSTICK_CURVE_P8(f, i)  JOYSTICK_CURVE_P4(f, i) JOYSTICK_CURVE_P4(f, (i) + 4)
+#define JOYSTICK_CURVE_P16(f, i) JOYSTICK_CURVE_P8(f, i) JOYSTICK_CURVE_P8(f, (i) + 8)
+#define JOYSTICK_CURVE_P32(f, i) JOYSTICK_CURVE_P16(f, i) JOYSTICK_CURVE_P16(f, (i) + 16)
+#define JOYSTICK_CURVE_P64(f, i) JOYSTICK_CURVE_P32(f, i) JOYSTICK_CURVE_P32(f, (i) + 32)
+
+// the first point of every segment
+#if JOYSTICK_CURVE_SEGMENTS == 8
+#define JOYSTICK_CURVE_FROM JOYSTICK_CURVE_P8
+#elif JOYSTICK_CURVE_SEGMENTS == 16
+#define JOYSTICK_CURVE_FROM JOYSTICK_CURVE_P16
+#elif JOYSTICK_CURVE_SEGMENTS == 32
+#define JOYSTICK_CURVE_FROM JOYSTICK_CURVE_P32
+#elif JOYSTICK_CURVE_SEGMENTS == 64
+#define JOYSTICK_CURVE_FROM JOYSTICK_CURVE_P64
+#else
+#error "JOYSTICK_CURVE_SEGMENT_SHIFT must be 10, 11, 12 or 13"
+#endif
+
+// Built-in curves, in flash
+extern const struct Joystick_curve Joystick_curveProgressive;	// x^2, fine control at the start (throttle, brake)
+extern const struct Joystick_curve Joystick_curveDegressive;	// 1-(1-x)^2, fast start
+extern const struct Joystick_curve Joystick_curveS;		// smoothstep, soft at both ends
+extern const struct Joystick_curve Joystick_curveExpo;	// cubic around the center, fine control near it (steering)
+
+/**
+ * Input report exactly as it goes on the wire (little-endian, no padding).
+ * The layout must match hidlayout.h, usbhid.c checks it.
+ */
+struct Joystick_report
+{
+	uint8_t reportId;
+	uint8_t buttons[HID_BUTTON_BYTES];
+#if HID_HAT_COUNT > 0
+	uint8_t hats[HID_HAT_BYTES];    // hat n in nibble n%2 (low first) of byte n/2
+#endif
+	int16_t axis[JOYSTICK_AXIS_COUNT];
+} __attribute__((packed));
 
 struct Joystick_
 {
-    //joystick state
-	uint8_t buttons;
-	int16_t xAxis;
-	int16_t yAxis;
-	int16_t zAxis;
-	int16_t wheel;
-	int16_t gas;
-	int16_t brake;
-
-    //joystick limits
-	int16_t                  _xAxisMinimum;
-	int16_t                  _xAxisMaximum;
-	int16_t                  _yAxisMinimum;
-	int16_t                  _yAxisMaximum;
-	int16_t                  _zAxisMinimum;
-	int16_t                  _zAxisMaximum;
-	int16_t                  _acceleratorMinimum;
-	int16_t                  _acceleratorMaximum;
-	int16_t                  _brakeMinimum;
-	int16_t                  _brakeMaximum;
-	int16_t                  _steeringMinimum;
-	int16_t                  _steeringMaximum;
+    //packed report, kept up to date by the setters
+	struct Joystick_report   _report;
+
+    //button bitmap, button n is bit n%32 of word n/32
+	uint32_t                 _buttons[JOYSTICK_BUTTON_WORDS];
+
+    //axis values, as given to the setters
+	int16_t                  _axisValue[JOYSTICK_AXIS_COUNT];
+
+    //axis limits, mapped onto JOYSTICK_AXIS_MINIMUM..JOYSTICK_AXIS_MAXIMUM.
+    //The scale factor is split in a whole part and a 0.32 fixed-point
+    //fraction so packing an axis takes a multiply and a shift, no divide.
+	int16_t                  _axisMinimum[JOYSTICK_AXIS_COUNT];
+	int16_t                  _axisMaximum[JOYSTICK_AXIS_COUNT];
+	bool                     _axisInverted[JOYSTICK_AXIS_COUNT];
+	uint32_t                 _axisWhole[JOYSTICK_AXIS_COUNT];
+	uint32_t                 _axisFraction[JOYSTICK_AXIS_COUNT];
+
+    //response curve applied after the scaling, NULL = linear
+	const struct Joystick_curve *_axisCurve[JOYSTICK_AXIS_COUNT];
+
+    //state sequence number, odd while a setter is writing (see joystick.c)
+	volatile uint32_t        _seq;
+	uint32_t                 _publishedSeq;
+	bool                     _publishPending;	//the queue was full, see Joystick_retryFromISR
+	uint16_t                 _frameSeq;
+	uint32_t                 _changeCycles;
+
+    //open batches, newest first (see Joystick_beginUpdate)
+	struct Joystick_batch   *_batches;
+
+    //change detection
+	struct Joystick_report   _lastReport;
+	bool                     _lastReportValid;
+	uint32_t                 _reportsSent;
+	uint32_t                 _reportsSuppressed;
 
 	QueueHandle_t *js_txq;
 
 };
 
+// One producer's batch of changes, published as a single report (see
+// Joystick_beginUpdate). The caller owns it, usually on its stack.
+struct Joystick_batch
+{
+	struct Joystick_batch   *next;
+	void                    *producer;
+	bool                     pending;
+};
+
 void Joystick_start(struct Joystick_ *js, QueueHandle_t *queue);
-void Joystick_setXAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
-void Joystick_setYAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
-void Joystick_setZAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
-void Joystick_setAcceleratorRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
-void Joystick_setBrakeRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
-void Joystick_setSteeringRange(struct Joystick_ *js, int16_t minimum, int16_t maximum);
 
 void Joystick_sendState(struct Joystick_ *js);
+void Joystick_sendStateFromISR(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken);
+void Joystick_retryFromISR(struct Joystick_ *js, BaseType_t *higherPriorityTaskWoken);
+uint32_t Joystick_getReport(struct Joystick_ *js, struct Joystick_report *report);
+uint32_t Joystick_getReportsSent(struct Joystick_ *js);
+uint32_t Joystick_getReportsSuppressed(struct Joystick_ *js);
+
+void Joystick_beginUpdate(struct Joystick_ *js, struct Joystick_batch *batch);
+void Joystick_commit(struct Joystick_ *js, struct Joystick_batch *batch);
+void Joystick_commitFromISR(struct Joystick_ *js, struct Joystick_batch *batch, BaseType_t *higherPriorityTaskWoken);
 
-void Joystick_setXAxis(struct Joystick_ *js, int16_t value);
-void Joystick_setYAxis(struct Joystick_ *js, int16_t value);
-void Joystick_setZAxis(struct Joystick_ *js, int16_t value);
-void Joystick_setAccelerator(struct Joystick_ *js, int16_t value);
-void Joystick_setBrake(struct Joystick_ *js, int16_t value);
-void Joystick_setSteering(struct Joystick_ *js, int16_t value);
+void Joystick_setAxisRange(struct Joystick_ *js, uint8_t axis, int16_t minimum, int16_t maximum);
+void Joystick_setAxisCurve(struct Joystick_ *js, uint8_t axis, const struct Joystick_curve *curve);
+void Joystick_setAxis(struct Joystick_ *js, uint8_t axis, int16_t value);
+void Joystick_setAxisFromISR(struct Joystick_ *js, uint8_t axis, int16_t value, BaseType_t *higherPriorityTaskWoken);
+void Joystick_setAxes(struct Joystick_ *js, const int16_t values[JOYSTICK_AXIS_COUNT]);
+void Joystick_setAxesFromISR(struct Joystick_ *js, const int16_t values[JOYSTICK_AXIS_COUNT], BaseType_t *higherPriorityTaskWoken);
+
+static inline void Joystick_setXAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_X, minimum, maximum); }
+static inline void Joystick_setYAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_Y, minimum, maximum); }
+static inline void Joystick_setZAxisRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_Z, minimum, maximum); }
+static inline void Joystick_setAcceleratorRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_ACCELERATOR, minimum, maximum); }
+static inline void Joystick_setBrakeRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_BRAKE, minimum, maximum); }
+static inline void Joystick_setSteeringRange(struct Joystick_ *js, int16_t minimum, int16_t maximum) { Joystick_setAxisRange(js, JOYSTICK_AXIS_STEERING, minimum, maximum); }
+
+static inline void Joystick_setXAxis(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_X, value); }
+static inline void Joystick_setYAxis(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_Y, value); }
+static inline void Joystick_setZAxis(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_Z, value); }
+static inline void Joystick_setAccelerator(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_ACCELERATOR, value); }
+static inline void Joystick_setBrake(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_BRAKE, value); }
+static inline void Joystick_setSteering(struct Joystick_ *js, int16_t value) { Joystick_setAxis(js, JOYSTICK_AXIS_STEERING, value); }
+
+static inline void Joystick_setXAxisFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_X, value, higherPriorityTaskWoken); }
+static inline void Joystick_setYAxisFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_Y, value, higherPriorityTaskWoken); }
+static inline void Joystick_setZAxisFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_Z, value, higherPriorityTaskWoken); }
+static inline void Joystick_setAcceleratorFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_ACCELERATOR, value, higherPriorityTaskWoken); }
+static inline void Joystick_setBrakeFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_BRAKE, value, higherPriorityTaskWoken); }
+static inline void Joystick_setSteeringFromISR(struct Joystick_ *js, int16_t value, BaseType_t *higherPriorityTaskWoken) { Joystick_setAxisFromISR(js, JOYSTICK_AXIS_STEERING, value, higherPriorityTaskWoken); }
 
 void Joystick_setButton(struct Joystick_ *js, uint8_t button, uint8_t value);
+void Joystick_setButtonFromISR(struct Joystick_ *js, uint8_t button, uint8_t value, BaseType_t *higherPriorityTaskWoken);
 void Joystick_pressButton(struct Joystick_ *js, uint8_t button);
+void Joystick_pressButtonFromISR(struct Joystick_ *js, uint8_t button, BaseType_t *higherPriorityTaskWoken);
 void Joystick_releaseButton(struct Joystick_ *js, uint8_t button);
+void Joystick_releaseButtonFromISR(struct Joystick_ *js, uint8_t button, BaseType_t *higherPriorityTaskWoken);
 void Joystick_setButtons(struct Joystick_ *js, uint8_t btns);
+void Joystick_setButtonsFromISR(struct Joystick_ *js, uint8_t btns, BaseType_t *higherPriorityTaskWoken);
+void Joystick_setButtonWord(struct Joystick_ *js, uint8_t word, uint32_t value);
+void Joystick_setButtonWordFromISR(struct Joystick_ *js, uint8_t word, uint32_t value, BaseType_t *higherPriorityTaskWoken);
+void Joystick_setButtonMask(struct Joystick_ *js, uint8_t word, uint32_t mask, uint32_t value);
+void Joystick_setButtonMaskFromISR(struct Joystick_ *js, uint8_t word, uint32_t mask, uint32_t value, BaseType_t *higherPriorityTaskWoken);
+
+#if HID_HAT_COUNT > 0
+void Joystick_setHat(struct Joystick_ *js, uint8_t hat, uint8_t directions);
+void Joystick_setHatFromISR(struct Joystick_ *js, uint8_t hat, uint8_t directions, BaseType_t *higherPriorityTaskWoken);
+void Joystick_setHats(struct Joystick_ *js, uint16_t directions);
+void Joystick_setHatsFromISR(struct Joystick_ *js, uint16_t directions, BaseType_t *higherPriorityTaskWoken);
+#endif
 
 #endif
\ No newline at end of file
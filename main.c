@@ -35,17 +35,54 @@
 
 #include "usbhid.h"
 #include "joystick.h"
+#include "adcscan.h"
+#include "demo.h"
 
 #define mainECHO_TASK_PRIORITY				( tskIDLE_PRIORITY + 1 )
 
 extern void vApplicationStackOverflowHook(xTaskHandle *pxTask,signed portCHAR *pcTaskName);
 
-// Communication queue
+// Communication queue: each item is a whole report (struct usbhid_frame)
 static QueueHandle_t joystick_txq;
 
 // instance of Joystick
 static 	struct Joystick_ joystick;
 
+/*
+ * ADCSCAN_AXES=1 reads the axes from the ADC (see adcscan.h) instead of
+ * running the xAxis demo task
+ */
+#ifndef ADCSCAN_AXES
+#define ADCSCAN_AXES 0
+#endif
+
+#if ADCSCAN_AXES && !USBHID_TXQ_MAILBOX
+#error "ADCSCAN_AXES needs USBHID_TXQ_MAILBOX=1, a report FIFO would only hold stale samples"
+#endif
+
+/*
+ * BENCHMARK_REPORTS=1 replaces the demo tasks with a producer that changes
+ * the report once per host poll (USBHID_POLL_MS) and checks every second
+ * that all of them reach the host. Any loss lights the PC13 led.
+ */
+#ifndef BENCHMARK_REPORTS
+#define BENCHMARK_REPORTS 0
+#endif
+
+#if BENCHMARK_REPORTS
+// results of the last second, for the debugger
+volatile struct {
+	uint32_t produced;
+	uint32_t sent;
+	uint32_t dropped;	// since start
+} benchmark;
+#endif
+
+#if configGENERATE_RUN_TIME_STATS
+// CPU load over the last second, in 1/1000, for the debugger
+volatile uint32_t cpu_load_permille;
+#endif
+
 void
 vApplicationStackOverflowHook(xTaskHandle *pxTask __attribute((unused)),signed portCHAR *pcTaskName __attribute((unused))) {
 	for(;;);
@@ -55,67 +92,132 @@ static void
 gpio_setup(void) {
 
 	rcc_clock_setup_in_hse_8mhz_out_72mhz();	// Use this for "blue pill"
+	usbhid_boot_mark(USBHID_BOOT_CLOCK);
 
 
 	rcc_periph_clock_enable(RCC_GPIOC);
 	gpio_set_mode(GPIOC,GPIO_MODE_OUTPUT_2_MHZ,GPIO_CNF_OUTPUT_PUSHPULL,GPIO13);
 }
 
+#if BENCHMARK_REPORTS
 /**
- * xAxis demo task
+ * Throughput benchmark task
  */
 static void
-axis_demo_task(void *args __attribute((unused))) {
-	int value = 0;
-	int increment = 10;
+benchmark_task(void *args __attribute((unused))) {
+	TickType_t wake = xTaskGetTickCount();
+	struct usbhid_stats last, now;
+	uint32_t produced = 0;
+	int16_t value = 0;
 
-	for (;;) {
+	while ( !usbhid_ready() )
 		vTaskDelay(pdMS_TO_TICKS(100));
-		if(value > JOYSTICK_DEFAULT_AXIS_MAXIMUM || value < JOYSTICK_DEFAULT_AXIS_MINIMUM)
-			increment = -increment;
+	usbhid_get_stats(&last);
+	wake = xTaskGetTickCount();
 
-		value += increment;
-
-		Joystick_setXAxis(&joystick, value);
+	for (;;) {
+		vTaskDelayUntil(&wake, pdMS_TO_TICKS(USBHID_POLL_MS));
+		value = value < JOYSTICK_DEFAULT_AXIS_MAXIMUM ? value + 1 : JOYSTICK_DEFAULT_AXIS_MINIMUM;
+		Joystick_setXAxis(&joystick, value);	// a new report every time
+		++produced;
+
+		if ( produced == 1000 / USBHID_POLL_MS ) {
+			usbhid_get_stats(&now);
+			benchmark.produced = produced;
+			benchmark.sent = now.frames_sent - last.frames_sent;
+			benchmark.dropped = now.frames_dropped;
+			if ( benchmark.dropped != 0 )
+				gpio_clear(GPIOC,GPIO13);	// led on
+			last = now;
+			produced = 0;
+		}
 	}
 }
+#endif
 
+#if configGENERATE_RUN_TIME_STATS
+/*
+ * Cycles run by the idle task so far
+ * (this kernel has no ulTaskGetIdleRunTimeCounter)
+ */
+static uint32_t
+idle_run_time(void) {
+	TaskStatus_t status;
+
+	vTaskGetInfo(xTaskGetIdleTaskHandle(), &status, pdFALSE, eInvalid);
+	return status.ulRunTimeCounter;
+}
 
 /**
- * buttons demo task
+ * CPU load task
+ * Load is the share of cycles not spent in the idle task
  */
-static void buttons_demo_task(void *arg __attribute((unused)))
-{
-	int8_t btn = 1;
-	int8_t next = 1;
+static void
+cpu_load_task(void *args __attribute((unused))) {
+	uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+	uint32_t idle = idle_run_time();
+	uint32_t now_total, now_idle;
 
 	for (;;) {
-		vTaskDelay(pdMS_TO_TICKS(500));
-		if(!(~btn))
-		{
-			next = 0;
-		}
-		if(!btn) next = 1;
-		btn = (btn<<1) | next;
+		vTaskDelay(pdMS_TO_TICKS(1000));
+		now_total = portGET_RUN_TIME_COUNTER_VALUE();
+		now_idle = idle_run_time();
 
-		Joystick_setButtons(&joystick, btn);
+		cpu_load_permille = 1000 - (uint32_t)((uint64_t)(now_idle - idle) * 1000 / (now_total - total));
+		total = now_total;
+		idle = now_idle;
 	}
 }
+#endif
+
+/*
+ * Current report for the host's GET_REPORT requests (USB interrupt)
+ */
+static void
+read_joystick_report(uint8_t report[PACKET_SIZE]) {
+	Joystick_getReport(&joystick, (struct Joystick_report *)report);
+}
+
+/*
+ * A frame left the report queue (USB interrupt): publish the state a full
+ * queue turned away, if any
+ */
+static void
+retry_joystick_report(BaseType_t *higherPriorityTaskWoken) {
+	Joystick_retryFromISR(&joystick, higherPriorityTaskWoken);
+}
 
 int
 main(void) {
 
-	joystick_txq = xQueueCreate(128,sizeof(char));
+	dwt_enable_cycle_counter();		// zeroed once, boot time starts here, see usbhid_boot_cycles
+	usbhid_boot_mark(USBHID_BOOT_RESET);
+
+	joystick_txq = xQueueCreate(USBHID_TXQ_LENGTH,sizeof(struct usbhid_frame));
 
 	gpio_setup();
 	
-	usbhid_start(&joystick_txq);
-
 	//joystick init
 	Joystick_start(&joystick, &joystick_txq);
 
-	xTaskCreate(axis_demo_task,"xAxis",50,NULL,configMAX_PRIORITIES-1,NULL);
-	xTaskCreate(buttons_demo_task,"Buttons",50,NULL,configMAX_PRIORITIES-1,NULL);
+	usbhid_set_report_source(read_joystick_report);
+	usbhid_set_queue_space(retry_joystick_report);
+	usbhid_start(&joystick_txq);
+
+#if BENCHMARK_REPORTS
+	gpio_set(GPIOC,GPIO13);		// led off
+	xTaskCreate(benchmark_task,"Bench",configMINIMAL_STACK_SIZE,NULL,configMAX_PRIORITIES-2,NULL);
+#else
+#if ADCSCAN_AXES
+	adcscan_start(&joystick);
+#else
+	xTaskCreate(axis_demo_task,"xAxis",configMINIMAL_STACK_SIZE,&joystick,configMAX_PRIORITIES-1,NULL);
+#endif
+	xTaskCreate(buttons_demo_task,"Buttons",configMINIMAL_STACK_SIZE,&joystick,configMAX_PRIORITIES-1,NULL);
+#endif
+#if configGENERATE_RUN_TIME_STATS
+	xTaskCreate(cpu_load_task,"Load",configMINIMAL_STACK_SIZE,NULL,mainECHO_TASK_PRIORITY,NULL);
+#endif
 
 
 	vTaskStartScheduler();
@@ -12,11 +12,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/hid.h>
+#include <libopencm3/cm3/nvic.h>
 
 #include <FreeRTOS.h>
 #include <task.h>
@@ -24,6 +26,7 @@
 
 
 #include "usbhid.h"
+#include "joystick.h"
 
 
 
@@ -31,6 +34,36 @@
 static volatile bool initialized = false;
 
 static usbd_device *usbd_dev;
+static QueueHandle_t *usb_txq;
+static volatile bool ep_busy = false;	/* the endpoint holds a report the host has not read */
+#if USBHID_LATENCY
+static uint32_t ep_cycles;		/* state change stamp of that report */
+#endif
+static struct usbhid_frame last_frame;	/* the last report sent */
+static bool last_frame_valid = false;
+
+/*
+ * HID class state, set by the host
+ */
+#define USBHID_REPORT_TYPE_INPUT	0x01
+#define USBHID_PROTOCOL_REPORT		0x01
+
+static volatile uint8_t idle_rate = 0;		/* 4 ms units, 0 = only on change */
+static usbhid_report_source report_source = NULL;
+static usbhid_queue_space queue_space = NULL;
+
+volatile uint32_t usbhid_boot_cycles[USBHID_BOOT_STEPS];
+static volatile uint32_t boot_marked = 0;
+static TaskHandle_t usb_task_handle;
+static BaseType_t usb_isr_woken;
+static const struct usbhid_frame wake_frame = { .len = 0 };	/* see struct usbhid_frame */
+
+/*
+ * The USB stack runs from the USB_LP interrupt. Its priority must be below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY so the callbacks can use the FromISR
+ * API, and so taskENTER_CRITICAL() in usb_task masks it.
+ */
+#define USBHID_IRQ_PRIORITY	(configMAX_SYSCALL_INTERRUPT_PRIORITY + 1)
 
 const struct usb_device_descriptor dev_descr = {
 	.bLength = USB_DT_DEVICE_SIZE,
@@ -51,55 +84,80 @@ const struct usb_device_descriptor dev_descr = {
 
 
 
+/*
+ * Generated from the layout in hidlayout.h: edit the layout there,
+ * not the bytes here
+ */
 static const uint8_t hid_report_descriptor[] = {
   0x05, 0x01, // USAGE_PAGE (Generic Desktop)
   0x09, 0x08, //JOYSTICK_TYPE_MULTI_AXIS, // USAGE (Multi axis)
   0xA1, 0x01, // COLLECTION (Application)
 	//================================Input Report======================================//
   	// WheelReport
-  	0x85, 0x03, //JOYSTICK_DEFAULT_REPORT_ID, // REPORT_ID (default 3)
-  	//0xA1, 0x00, // COLLECTION (Physical)
+  	0x85, HID_REPORT_ID, // REPORT_ID (default 3)
   	0x05, 0x09, // USAGE_PAGE  (Button)
   	0x19, 0x01, // USAGE_MINIMUM (Button 1)
-  	0x29, 0x08, // USAGE_MAXIMUM (Button 8)
+  	0x29, HID_BUTTON_COUNT, // USAGE_MAXIMUM (Button HID_BUTTON_COUNT)
   	0x15, 0x00, // LOGICAL_MINIMUM (0)
   	0x25, 0x01, // LOGICAL_MAXIMUM (1)
   	0x75, 0x01, // REPORT_SIZE (1)
-  	0x95, 0x08, // REPORT_COUNT (8)
+  	0x95, HID_BUTTON_COUNT, // REPORT_COUNT (HID_BUTTON_COUNT)
   	0x55, 0x00, // UNIT_EXPONENT (0)
   	0x65, 0x00, // UNIT (None)
   	0x81, 0x02, //INPUT (Data,Var,Abs)
+#if HID_BUTTON_PADDING > 0
+  	0x75, HID_BUTTON_PADDING, // REPORT_SIZE (pad to a whole byte)
+  	0x95, 0x01, // REPORT_COUNT (1)
+  	0x81, 0x03, // INPUT (Cnst,Var,Abs)
+#endif
+
+#if HID_HAT_COUNT > 0
+  	//HID_HAT_COUNT hat switches, 4 bit each
+  	0x05, 0x01, // USAGE_PAGE (Generic Desktop)
+  	0x09, 0x39, // USAGE (Hat switch)
+  	0x15, 0x00, // LOGICAL_MINIMUM (0)
+  	0x25, 0x07, // LOGICAL_MAXIMUM (7)
+  	0x35, 0x00, // PHYSICAL_MINIMUM (0)
+  	0x46, 0x3B, 0x01, // PHYSICAL_MAXIMUM (315)
+  	0x65, 0x14, // UNIT (Eng Rot:Angular Pos)
+  	0x75, 0x04, // REPORT_SIZE (4)
+  	0x95, HID_HAT_COUNT, // REPORT_COUNT (HID_HAT_COUNT)
+  	0x81, 0x42, // INPUT (Data,Var,Abs,Null)
+#if HID_HAT_COUNT % 2
+  	0x95, 0x01, // REPORT_COUNT (1)
+  	0x81, 0x03, // INPUT (Cnst,Var,Abs)
+#endif
+  	0x35, 0x00, // PHYSICAL_MINIMUM (0)
+  	0x45, 0x00, // PHYSICAL_MAXIMUM (0)
+  	0x65, 0x00, // UNIT (None)
+#endif
 
-  	//3 Axis: X, Y, Z
+  	//HID_AXIS_COUNT axis, 16 bit each
   	0x05, 0x01, // USAGE_PAGE (Generic Desktop)
   	0x09, 0x01, // USAGE (Pointer)
-  	0x16, 0x01, 0x80, //LOGICAL_MINIMUM (-32768)
+  	0x16, 0x01, 0x80, //LOGICAL_MINIMUM (-32767)
   	0x26, 0xFF, 0x7F, //LOGICAL_MAXIMUM (32767)
   	0x75, 0x10, // REPORT_SIZE (16)
-  	0x95, 0x03, // REPORT_COUNT (3)
+  	0x95, 0x01, // REPORT_COUNT (1)
   	0xA1, 0x00, // COLLECTION (Physical)
-  		0x09, 0x30, // USAGE (X)
-  		0x09, 0x31, // USAGE (Y)
-  		0x09, 0x32, // USAGE (Z)
-  		0x81, 0x02, // INPUT (Data,Var,Abs)
+  		HID_AXES(HID_DESCRIPTOR_AXIS)
   	0xc0, // END_COLLECTION (Physical)
 
-  	//simulation 3 Axis
-  	0x05, 0x02, // USAGE_PAGE (Simulation Controls)
-  	0x16, 0x01, 0x80, //LOGICAL_MINIMUM (-32768)
-  	0x26, 0xFF, 0x7F, //LOGICAL_MAXIMUM (32767)
-  	0x75, 0x10, // REPORT_SIZE (16)
-  	0x95, 0x03, // REPORT_COUNT (3)
-  	0xA1, 0x00, // COLLECTION (Physical)
-  		0x09, 0xC4, // USAGE (Accelerator)
-  		0x09, 0xC5, // USAGE (Brake)
-  		0x09, 0xC8, // USAGE (Steering)
-  		0x81, 0x02, // INPUT (Data,Var,Abs)
-  	0xc0, // END_COLLECTION 
-
   0xC0, // END COLLECTION ()
 };
 
+// struct Joystick_report must be laid out exactly as described above
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "HID reports are little-endian");
+_Static_assert(HID_AXIS_MINIMUM == -32767 && HID_AXIS_MAXIMUM == 32767, "axis limits are hard coded in the descriptor");
+_Static_assert(sizeof(struct Joystick_report) == HID_REPORT_SIZE, "report struct does not match hidlayout.h");
+_Static_assert(offsetof(struct Joystick_report, reportId) == 0, "REPORT_ID must come first");
+_Static_assert(offsetof(struct Joystick_report, buttons) == HID_REPORT_BUTTONS_OFFSET, "report struct does not match hidlayout.h");
+#if HID_HAT_COUNT > 0
+_Static_assert(offsetof(struct Joystick_report, hats) == HID_REPORT_HATS_OFFSET, "report struct does not match hidlayout.h");
+#endif
+_Static_assert(offsetof(struct Joystick_report, axis) == HID_REPORT_AXIS_OFFSET(0), "report struct does not match hidlayout.h");
+_Static_assert(PACKET_SIZE <= 64, "a report must fit in one full speed packet");
+
 
 static const struct {
 	struct usb_hid_descriptor hid_descriptor;
@@ -127,7 +185,7 @@ const struct usb_endpoint_descriptor hid_endpoint = {
 	.bEndpointAddress = 0x81,
 	.bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
 	.wMaxPacketSize = PACKET_SIZE, //4,
-	.bInterval = 0x20,
+	.bInterval = USBHID_POLL_MS,
 };
 
 const struct usb_interface_descriptor hid_iface = {
@@ -137,8 +195,8 @@ const struct usb_interface_descriptor hid_iface = {
 	.bAlternateSetting = 0,
 	.bNumEndpoints = 1,
 	.bInterfaceClass = USB_CLASS_HID,
-	.bInterfaceSubClass = 1, /* boot */
-	.bInterfaceProtocol = 2, /* mouse */
+	.bInterfaceSubClass = 0, /* no boot protocol, see SET_PROTOCOL */
+	.bInterfaceProtocol = 0,
 	.iInterface = 0,
 
 	.endpoint = &hid_endpoint,
@@ -192,50 +250,331 @@ static enum usbd_request_return_codes hid_control_request(usbd_device *dev, stru
 	return USBD_REQ_HANDLED;
 }
 
+/*
+ * HID class requests (USB interrupt)
+ * There is no boot interface, so only the report protocol is accepted.
+ */
+static enum usbd_request_return_codes hid_class_request(usbd_device *dev, struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
+			void (**complete)(usbd_device *, struct usb_setup_data *))
+{
+	(void)complete;
+	(void)dev;
+
+	switch ( req->bRequest ) {
+	case USB_HID_REQ_TYPE_GET_REPORT:
+		if ( (req->wValue >> 8) != USBHID_REPORT_TYPE_INPUT || (req->wValue & 0xFF) != HID_REPORT_ID )
+			return USBD_REQ_NOTSUPP;
+		if ( report_source )
+			report_source(*buf);
+		else if ( last_frame_valid )
+			memcpy(*buf, last_frame.data, PACKET_SIZE);
+		else
+			return USBD_REQ_NOTSUPP;
+		*len = PACKET_SIZE;
+		return USBD_REQ_HANDLED;
+
+	case USB_HID_REQ_TYPE_GET_IDLE:
+		(*buf)[0] = idle_rate;
+		*len = 1;
+		return USBD_REQ_HANDLED;
+
+	case USB_HID_REQ_TYPE_SET_IDLE:
+		idle_rate = req->wValue >> 8;		/* same for every report id, there is one */
+		/*
+		 * New deadline: usb_task may be waiting on the queue with the old
+		 * one, an empty frame ends that wait. A full queue wakes it anyway.
+		 */
+		xQueueSendToFrontFromISR(*usb_txq, &wake_frame, &usb_isr_woken);
+		return USBD_REQ_HANDLED;
+
+	case USB_HID_REQ_TYPE_GET_PROTOCOL:
+		(*buf)[0] = USBHID_PROTOCOL_REPORT;
+		*len = 1;
+		return USBD_REQ_HANDLED;
+
+	case USB_HID_REQ_TYPE_SET_PROTOCOL:
+		if ( (req->wValue & 0xFF) != USBHID_PROTOCOL_REPORT )
+			return USBD_REQ_NOTSUPP;	/* stall the boot protocol */
+		return USBD_REQ_HANDLED;
+	}
+	return USBD_REQ_NOTSUPP;
+}
+
+
+
+/*
+ * Frame accounting, see struct usbhid_frame
+ */
+static struct usbhid_stats stats;
+static bool stats_seq_valid = false;
+static uint16_t stats_next_seq;
+
+/*
+ * Checks a frame taken from the queue.
+ * Returns true if it is a complete report that can be sent.
+ */
+static bool
+usbhid_accept_frame(const struct usbhid_frame *frame) {
+	if ( frame->len == 0 )		/* wake up only, not a report */
+		return false;
+	if ( stats_seq_valid ) {
+#if USBHID_TXQ_MAILBOX
+		stats.frames_coalesced += (uint16_t)(frame->seq - stats_next_seq);
+#else
+		stats.frames_dropped += (uint16_t)(frame->seq - stats_next_seq);
+#endif
+	}
+	stats_next_seq = frame->seq + 1;
+	stats_seq_valid = true;
+	if ( frame->len != PACKET_SIZE ) {
+		++stats.frames_partial;
+		++stats.frames_dropped;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Loads the next complete frame from the queue into the endpoint.
+ * Runs in the USB interrupt, or in usb_task with it masked.
+ * Returns false, leaving the endpoint idle, when the queue is empty.
+ */
+static bool
+usbhid_send_next(void) {
+	struct usbhid_frame frame;
+	uint16_t len;
+
+	while ( xQueueReceiveFromISR(*usb_txq, &frame, NULL) == pdPASS ) {
+		if ( queue_space )
+			queue_space(NULL);	/* usb_task, the reader, has nothing to do before the endpoint is free */
+		if ( !usbhid_accept_frame(&frame) )
+			continue;
+
+		len = usbd_ep_write_packet(usbd_dev,0x81,frame.data,PACKET_SIZE); //0x82
+		if ( len == 0 ) {		/* Endpoint not ready after all, the frame is lost */
+			++stats.frames_dropped;
+			break;
+		}
+		if ( len != PACKET_SIZE ) {
+			++stats.frames_partial;
+			++stats.frames_dropped;
+		} else {
+			++stats.frames_sent;
+#if USBHID_LATENCY
+			stats.latency_last = usbhid_cycles() - frame.cycles;
+			if ( stats.latency_last > stats.latency_max )
+				stats.latency_max = stats.latency_last;
+			ep_cycles = frame.cycles;
+#endif
+			last_frame = frame;
+			last_frame_valid = true;
+		}
+		ep_busy = true;
+		return true;
+	}
+	ep_busy = false;
+	return false;
+}
+
+/*
+ * Sends the last report again, when the idle rate deadline has passed
+ * without a new one. Same context as usbhid_send_next().
+ */
+static bool
+usbhid_send_last(void) {
+	if ( !last_frame_valid
+	  || usbd_ep_write_packet(usbd_dev,0x81,last_frame.data,PACKET_SIZE) == 0 )
+		return false;
+
+	++stats.frames_repeated;
+#if USBHID_LATENCY
+	ep_cycles = usbhid_cycles();
+#endif
+	ep_busy = true;
+	return true;
+}
+
+/*
+ * Endpoint 0x81 transfer complete (USB interrupt): the host has taken the
+ * last report, load the next one right away. When there is none, hand the
+ * idle endpoint back to usb_task.
+ */
+static void hid_ep_tx_complete(usbd_device *dev __attribute((unused)), uint8_t ep __attribute((unused)))
+{
+	usbhid_boot_mark(USBHID_BOOT_FIRST_REPORT);
+#if USBHID_LATENCY
+	stats.pickup_last = usbhid_cycles() - ep_cycles;
+	if ( stats.pickup_last > stats.pickup_max )
+		stats.pickup_max = stats.pickup_last;
+#endif
+	if ( !usbhid_send_next() )
+		vTaskNotifyGiveFromISR(usb_task_handle, &usb_isr_woken);
+}
 
+/*
+ * Bus reset (USB interrupt): the device is no longer configured and the
+ * endpoint content is gone
+ */
+static void hid_reset(void)
+{
+	initialized = false;
+	ep_busy = false;
+	idle_rate = 0;
+}
 
 static void hid_set_config(usbd_device *dev, uint16_t wValue __attribute((unused)))
 {
 //	(void)dev;
 
-	usbd_ep_setup(dev, 0x81, USB_ENDPOINT_ATTR_INTERRUPT, PACKET_SIZE, NULL);
+	/*
+	 * Single buffered: the STM32F1 USB peripheral double buffers bulk and
+	 * isochronous endpoints only. The next report waits in the queue (the
+	 * second buffer) and is loaded by hid_ep_tx_complete() as soon as the
+	 * host has read this one; stats.pickup_* show what that costs.
+	 */
+	usbd_ep_setup(dev, 0x81, USB_ENDPOINT_ATTR_INTERRUPT, PACKET_SIZE, hid_ep_tx_complete);
 
 	usbd_register_control_callback(
 				dev,
 				USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_INTERFACE,
 				USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
 				hid_control_request);
+	usbd_register_control_callback(
+				dev,
+				USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+				USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+				hid_class_request);
 
+	ep_busy = false;
     initialized = true;
+	usbhid_boot_mark(USBHID_BOOT_SET_CONFIG);
+	vTaskNotifyGiveFromISR(usb_task_handle, &usb_isr_woken);	/* usb_task waits for this */
+}
+
+/*
+ * USB low priority interrupt: all the driver work happens here
+ */
+void
+usb_lp_can_rx0_isr(void) {
+	usb_isr_woken = pdFALSE;
+	usbd_poll(usbd_dev);
+	portYIELD_FROM_ISR(usb_isr_woken);
+}
+
+/*
+ * Record a boot step, the first time only
+ */
+void
+usbhid_boot_mark(enum usbhid_boot_step step) {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+	if ( !(boot_marked & (1u << step)) ) {
+		usbhid_boot_cycles[step] = dwt_read_cycle_counter();
+		boot_marked |= 1u << step;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/*
+ * Ends the startup disconnect (see usbhid_start) and hands the device to
+ * the USB interrupt. Runs in usb_task, so the wait blocks nothing else.
+ */
+static void
+usbhid_connect(void) {
+	vTaskDelay(pdMS_TO_TICKS(USBHID_DISCONNECT_MS) + 1);	/* at least USBHID_DISCONNECT_MS */
+
+	// PA11=USB_DM, PA12=USB_DP
+	usbd_dev = usbd_init(USBHID_DRIVER,&dev_descr,&config,
+		usb_strings,3,
+		usbd_control_buffer,sizeof(usbd_control_buffer));
+
+	usbd_register_set_config_callback(usbd_dev,hid_set_config);
+	usbd_register_reset_callback(usbd_dev,hid_reset);
+	usbhid_boot_mark(USBHID_BOOT_USBD_INIT);
+
+	nvic_set_priority(NVIC_USB_LP_CAN_RX0_IRQ,USBHID_IRQ_PRIORITY);
+	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+}
+
+/*
+ * How long the reports may stay quiet before the last one is sent again:
+ * the idle rate set by the host or JOYSTICK_HEARTBEAT_MS, the shorter one
+ */
+static TickType_t
+usbhid_refresh_ticks(void) {
+	TickType_t ticks = portMAX_DELAY;
+
+	if ( idle_rate )
+		ticks = pdMS_TO_TICKS(4 * (uint32_t)idle_rate);
+#if JOYSTICK_HEARTBEAT_MS > 0
+	if ( pdMS_TO_TICKS(JOYSTICK_HEARTBEAT_MS) < ticks )
+		ticks = pdMS_TO_TICKS(JOYSTICK_HEARTBEAT_MS);
+#endif
+	return ticks;
 }
 
 /*
  * USB Driver task:
- * Listen to joystick queue. When data is ready, send it to the host
+ * Starts the transmission when a report is queued while the endpoint is
+ * idle. From then on the endpoint complete callback loads every following
+ * report as soon as the host has read the previous one, one write per host
+ * poll, and the task sleeps until the queue runs dry.
+ * The last report is sent again when no new one arrives for the idle rate
+ * set by the host, or for JOYSTICK_HEARTBEAT_MS, after the previous one.
  */
 static void
-usb_task(void *arg) {
-	QueueHandle_t *js_txq = (QueueHandle_t *)arg;
-	char txbuf[PACKET_SIZE];
-	unsigned txlen = 0;
+usb_task(void *arg __attribute((unused))) {
+	struct usbhid_frame frame;
+	bool ready;
+
+	usbhid_connect();
 
 	for (;;) {
-		usbd_poll(usbd_dev);			/* Allow driver to do it's thing */
-		if ( initialized ) {
-			while ( txlen < PACKET_SIZE //sizeof txbuf
-			   && xQueueReceive(*js_txq, &txbuf[txlen],0) == pdPASS ) //joystick_txq
-				++txlen;		/* Read data to be sent */
-			
-			if ( txlen > 0 ) {
-				if ( usbd_ep_write_packet(usbd_dev,0x81,txbuf,txlen) != 0 ) //0x82
-					txlen = 0;	/* Reset if data sent ok */
-			} else	{
-				taskYIELD();		/* Then give up CPU */
-			}
+		if ( xQueuePeek(*usb_txq, &frame, usbhid_refresh_ticks()) == pdPASS ) {	/* Wait for a report, leave it queued */
+			taskENTER_CRITICAL();		/* The driver belongs to the USB interrupt */
+			ready = initialized && !ep_busy;
+			if ( ready )
+				usbhid_send_next();	/* or only empties the queue of wake frames */
+			taskEXIT_CRITICAL();
+		} else {			/* Idle or heartbeat deadline */
+			taskENTER_CRITICAL();
+			ready = initialized && !ep_busy;
+			if ( ready )
+				usbhid_send_last();
+			taskEXIT_CRITICAL();
 		}
+
+		if ( !ready )		/* Configuration pending or endpoint busy */
+			ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
 	}
 }
 
+/*
+ * Copy the frame counters
+ */
+void
+usbhid_get_stats(struct usbhid_stats *s) {
+	taskENTER_CRITICAL();
+	*s = stats;
+	taskEXIT_CRITICAL();
+}
+
+
+/*
+ * Set the GET_REPORT source, before usbhid_start()
+ */
+void
+usbhid_set_report_source(usbhid_report_source source) {
+	report_source = source;
+}
+
+/*
+ * Set the queue space notification, before usbhid_start()
+ */
+void
+usbhid_set_queue_space(usbhid_queue_space notify) {
+	queue_space = notify;
+}
 
 /*
  * Start USB driver:
@@ -246,31 +585,22 @@ usbhid_start(QueueHandle_t *joystick_txq) {
 
 	rcc_periph_clock_enable(RCC_GPIOA);
 	rcc_periph_clock_enable(RCC_USB);
+	usbhid_cycles_start();
 	/*
 	 * This is a somewhat common cheap hack to trigger device re-enumeration
 	 * on startup.  Assuming a fixed external pullup on D+, (For USB-FS)
 	 * setting the pin to output, and driving it explicitly low effectively
 	 * "removes" the pullup.  The subsequent USB init will "take over" the
 	 * pin, and it will appear as a proper pullup to the host.
-	 * The magic delay is somewhat arbitrary, no guarantees on USBIF
-	 * compliance here, but "it works" in most places.
+	 * usb_task does that after USBHID_DISCONNECT_MS, timed by the RTOS.
 	 */
 	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_2_MHZ,
 		GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
 	gpio_clear(GPIOA, GPIO12);
-	for (unsigned i = 0; i < 800000; i++) {
-		__asm__("nop");
-	}
-
-	// PA11=USB_DM, PA12=USB_DP
-	usbd_dev = usbd_init(&st_usbfs_v1_usb_driver,&dev_descr,&config,
-		usb_strings,3,
-		usbd_control_buffer,sizeof(usbd_control_buffer));
-
-	usbd_register_set_config_callback(usbd_dev,hid_set_config);
-
+	usbhid_boot_mark(USBHID_BOOT_DISCONNECT);
 
-	xTaskCreate(usb_task,"USB",200,joystick_txq,configMAX_PRIORITIES-1,NULL);
+	usb_txq = joystick_txq;
+	xTaskCreate(usb_task,"USB",200,NULL,configMAX_PRIORITIES-1,&usb_task_handle);
 }
 
 /*
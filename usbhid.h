@@ -1,10 +1,158 @@
 #ifndef LIBUSBCDC_H
 #define LIBUSBCDC_H
 
-#define PACKET_SIZE 14
+#include "hidlayout.h"
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+
+#define PACKET_SIZE HID_REPORT_SIZE
+
+/*
+ * Report transport between the joystick and usb_task.
+ * USBHID_TXQ_MAILBOX=1 keeps only the newest report (overwrite semantics),
+ * so the host always reads the current state. Otherwise reports are queued
+ * in order, USBHID_TXQ_LENGTH deep: a report may then be up to that many
+ * host polls old when it is sent.
+ * The ADC axes (ADCSCAN_AXES=1) publish every millisecond, far more often
+ * than the host polls, so they default to the mailbox.
+ */
+#ifndef USBHID_TXQ_MAILBOX
+#if defined(ADCSCAN_AXES) && ADCSCAN_AXES
+#define USBHID_TXQ_MAILBOX 1
+#else
+#define USBHID_TXQ_MAILBOX 0
+#endif
+#endif
+
+#if USBHID_TXQ_MAILBOX
+#undef USBHID_TXQ_LENGTH
+#define USBHID_TXQ_LENGTH 1
+#elif !defined(USBHID_TXQ_LENGTH)
+#define USBHID_TXQ_LENGTH 8
+#endif
+
+/*
+ * Host polling interval of the report endpoint, in ms (full speed
+ * bInterval): 1 (1000 reports/s), 2, 4, 8 or 32
+ */
+#ifndef USBHID_POLL_MS
+#define USBHID_POLL_MS 32
+#endif
+
+#if USBHID_POLL_MS != 1 && USBHID_POLL_MS != 2 && USBHID_POLL_MS != 4 && USBHID_POLL_MS != 8 && USBHID_POLL_MS != 32
+#error "USBHID_POLL_MS must be 1, 2, 4, 8 or 32"
+#endif
+
+/*
+ * USBHID_LATENCY=1 measures, in CPU cycles (DWT cycle counter), the time
+ * from the last state change of a report to the endpoint accepting it
+ * (latency), and to the host reading it (pickup).
+ * A setter called first thing in an interrupt handler makes this the
+ * ISR entry to endpoint latency.
+ */
+#ifndef USBHID_LATENCY
+#define USBHID_LATENCY 1
+#endif
+
+/*
+ * Starts the cycle counter without zeroing it, unlike
+ * dwt_enable_cycle_counter(): main() zeroes it once, where the boot time
+ * starts, and every cycle count shares that time base.
+ */
+static inline void usbhid_cycles_start(void) {
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+static inline uint32_t usbhid_cycles(void) {
+#if USBHID_LATENCY
+	return dwt_read_cycle_counter();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Framing contract: producers queue whole struct usbhid_frame items with
+ * len == PACKET_SIZE, and number them with seq, one step for every frame
+ * they try to queue. usb_task sends only complete frames and counts the
+ * missing sequence numbers: as coalesced in the mailbox, where a newer
+ * report overwrote them, as dropped in a FIFO. A frame with len == 0 carries no
+ * report: the USB interrupt queues one to wake usb_task, see SET_IDLE.
+ */
+struct usbhid_frame {
+	uint16_t seq;
+	uint8_t  len;
+	uint32_t cycles;		/* usbhid_cycles() at the last state change */
+	uint8_t  data[PACKET_SIZE];
+};
+
+struct usbhid_stats {
+	uint32_t frames_sent;		/* written to the endpoint */
+	uint32_t frames_dropped;	/* lost: never queued, or partial */
+	uint32_t frames_coalesced;	/* overwritten in the mailbox by a newer report */
+	uint32_t frames_partial;	/* rejected for a wrong length */
+	uint32_t frames_repeated;	/* last report sent again, idle rate or heartbeat */
+	uint32_t latency_last;		/* cycles, see USBHID_LATENCY */
+	uint32_t latency_max;
+	uint32_t pickup_last;		/* cycles from state change to the host reading it */
+	uint32_t pickup_max;
+};
+
+/*
+ * Boot time instrumentation: DWT cycle count at each step of the way to
+ * the first report, recorded once. The counter runs from the start of
+ * main(), at 8MHz until the clock setup and at 72MHz after it.
+ */
+enum usbhid_boot_step {
+	USBHID_BOOT_RESET,		/* main() entered */
+	USBHID_BOOT_CLOCK,		/* system clock set up */
+	USBHID_BOOT_DISCONNECT,		/* D+ pulled low */
+	USBHID_BOOT_USBD_INIT,		/* reconnected, driver initialized */
+	USBHID_BOOT_SET_CONFIG,		/* host SET_CONFIGURATION */
+	USBHID_BOOT_FIRST_REPORT,	/* first report read by the host */
+	USBHID_BOOT_STEPS
+};
+
+extern volatile uint32_t usbhid_boot_cycles[USBHID_BOOT_STEPS];
+void usbhid_boot_mark(enum usbhid_boot_step step);
+
+/*
+ * Time D+ is held low at startup so the host sees a disconnect and
+ * enumerates again. A hub only notices it at its next port status poll,
+ * so it is a few ms rather than the 2.5us the spec requires.
+ */
+#ifndef USBHID_DISCONNECT_MS
+#define USBHID_DISCONNECT_MS 10
+#endif
+
+/*
+ * libopencm3 driver for the USB peripheral. A build for another target
+ * (or a fake device driver) can name its own usbd_driver here.
+ */
+#ifndef USBHID_DRIVER
+#define USBHID_DRIVER (&st_usbfs_v1_usb_driver)
+#endif
 
 void usbhid_start(QueueHandle_t *joystick_txq);
 bool usbhid_ready(void);
+void usbhid_get_stats(struct usbhid_stats *stats);
+
+/*
+ * Source of the current report for GET_REPORT requests. It is called from
+ * the USB interrupt. Without one the last report sent is returned.
+ */
+typedef void (*usbhid_report_source)(uint8_t report[PACKET_SIZE]);
+void usbhid_set_report_source(usbhid_report_source source);
+
+/*
+ * Called each time a frame leaves the queue, from the USB interrupt or
+ * from usb_task with it masked: a producer the full queue turned away can
+ * publish its state again, so the last state is never lost.
+ */
+typedef void (*usbhid_queue_space)(BaseType_t *higherPriorityTaskWoken);
+void usbhid_set_queue_space(usbhid_queue_space notify);
 
 
 #endif /* LIBUSBCDC_H */